@@ -0,0 +1,363 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// chip8-aot: statically recompiles a rom into C++ source implementing the
+// symbols in aot.h. Code is found by recursive descent from 0x200 and every
+// basic block becomes a label; anything the descent can't follow (00EE
+// returns, BNNN) goes back through a switch on PC, and blocks the switch
+// doesn't know, FX0A and BNNN are left to the interpreter.
+
+enum class Kind {
+    Straight,       // falls through to the next instruction
+    Store,          // FX33 and FX55, end a block since they can rewrite what follows
+    Jump,
+    Call,
+    Return,
+    Skip,
+    Interpreted     // FX0A and BNNN
+};
+
+static Kind classify(std::uint16_t opcode) {
+    switch (opcode >> 12) {
+        case 0x0:
+            return opcode == 0x00EE ? Kind::Return : Kind::Straight;
+        case 0x1:
+            return Kind::Jump;
+        case 0x2:
+            return Kind::Call;
+        case 0x3: case 0x4: case 0x5: case 0x9:
+            return Kind::Skip;
+        case 0xB:
+            return Kind::Interpreted;
+        case 0xE:
+            return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1 ? Kind::Skip : Kind::Straight;
+        case 0xF:
+            if ((opcode & 0xFF) == 0x0A) return Kind::Interpreted;
+            if ((opcode & 0xFF) == 0x33 || (opcode & 0xFF) == 0x55) return Kind::Store;
+            return Kind::Straight;
+        default:
+            return Kind::Straight;
+    }
+}
+
+static std::string hex(unsigned value, int digits = 3) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+    return buffer;
+}
+
+class Compiler {
+public:
+    explicit Compiler(const std::vector<std::uint8_t> &rom) : rom_(rom) {}
+
+    void discover() {
+        std::vector<std::uint16_t> work = {0x200};
+        while (!work.empty()) {
+            std::uint16_t start = work.back();
+            work.pop_back();
+            if (!in_rom(start) || starts_.count(start)) continue;
+            starts_.insert(start);
+
+            for (std::uint16_t address = start; ; address += 2) {
+                if (!in_rom(address)) break;
+                std::uint16_t opcode = fetch(address);
+                Kind kind = classify(opcode);
+                if (kind == Kind::Straight) continue;
+
+                switch (kind) {
+                    case Kind::Store:
+                        work.push_back(address + 2);
+                        break;
+                    case Kind::Jump:
+                        work.push_back(opcode & 0xFFF);
+                        break;
+                    case Kind::Call:
+                        work.push_back(opcode & 0xFFF);
+                        work.push_back(address + 2);
+                        break;
+                    case Kind::Skip:
+                        work.push_back(address + 2);
+                        work.push_back(address + 4);
+                        break;
+                    case Kind::Interpreted:
+                        // the interpreter runs this one and comes back after it
+                        if ((opcode >> 12) != 0xB) work.push_back(address + 2);
+                        break;
+                    default:
+                        break;
+                }
+                break;
+            }
+        }
+    }
+
+    std::string generate(const std::string &rom_name) {
+        std::ostringstream out;
+        out << "// Generated by chip8-aot from " << rom_name << ", do not edit.\n"
+            << "#include <cstring>\n"
+            << "#include \"aot.h\"\n\n"
+            << "const std::uint8_t chip8_aot_rom[] = {";
+        for (std::size_t i = 0; i < rom_.size(); i++) {
+            out << (i % 16 == 0 ? "\n        " : " ") << hex(rom_[i], 2) << ",";
+        }
+        out << "\n};\n"
+            << "const std::size_t chip8_aot_rom_size = " << rom_.size() << ";\n\n"
+            << "int chip8_aot_run(Chip8 &chip8, int budget) {\n"
+            << "    std::array<std::uint8_t, 16> &V = chip8.gpv_registers;\n"
+            << "    int executed = 0;\n\n";
+
+        // blocks first, only returns jump back to the dispatch and a rom without
+        // any would leave its label unused
+        std::ostringstream blocks;
+        for (std::uint16_t start : starts_) {
+            if (emitted(start)) emit_block(blocks, start);
+        }
+
+        if (uses_dispatch_) out << "dispatch:\n";
+        out << "    switch (chip8.PC) {\n";
+        for (std::uint16_t start : starts_) {
+            if (emitted(start)) out << "        case " << hex(start) << ": goto block_" << label(start) << ";\n";
+        }
+        out << "        default: return executed;\n"
+            << "    }\n"
+            << blocks.str()
+            << "}\n";
+        return out.str();
+    }
+
+private:
+    bool in_rom(std::uint16_t address) const {
+        return address >= 0x200 && (std::size_t)address + 1 < 0x200 + rom_.size() && address < 0xFFF;
+    }
+
+    std::uint16_t fetch(std::uint16_t address) const {
+        return (rom_[address - 0x200] << 8) | rom_[address - 0x200 + 1];
+    }
+
+    bool emitted(std::uint16_t start) const {
+        return starts_.count(start) && in_rom(start) && classify(fetch(start)) != Kind::Interpreted;
+    }
+
+    static std::string label(std::uint16_t address) {
+        return hex(address).substr(2);
+    }
+
+    // continue at `target`, straight into its block when it has one
+    std::string go_to(std::uint16_t target) const {
+        std::string set_pc = "chip8.PC = " + hex(target) + "; ";
+        return set_pc + (emitted(target) ? "goto block_" + label(target) + ";" : "return executed;");
+    }
+
+    void emit_block(std::ostringstream &out, std::uint16_t start) {
+        // find where the block ends: at a control transfer, after a store, or
+        // where another block starts
+        std::uint16_t end = start;
+        bool include_last = false;
+        while (in_rom(end)) {
+            if (end != start && starts_.count(end)) break;
+            Kind kind = classify(fetch(end));
+            if (kind == Kind::Interpreted) break;
+            if (kind != Kind::Straight) {
+                include_last = true;
+                break;
+            }
+            end += 2;
+        }
+        std::uint16_t stop = include_last ? end + 2 : end;
+        int instructions = (stop - start) / 2;
+
+        unsigned long long pages = 0;
+        for (int page = start / 64; page <= (stop - 1) / 64; page++) pages |= 1ull << page;
+        char page_mask[32];
+        snprintf(page_mask, sizeof(page_mask), "0x%016llXull", pages);
+
+        out << "\nblock_" << label(start) << ":\n"
+            << "    if (budget - executed < " << instructions << ") return executed;\n"
+            << "    if ((chip8.written_pages & " << page_mask << ") != 0 &&\n"
+            << "        memcmp(&chip8.memory[" << hex(start) << "], &chip8_aot_rom[" << hex(start - 0x200) << "], "
+            << stop - start << ") != 0) return executed;\n"
+            << "    executed += " << instructions << ";\n";
+
+        // the opcode mix of the whole block, counted up front like `executed`
+        int nibbles[16] = {};
+        for (std::uint16_t address = start; address < stop; address += 2) nibbles[fetch(address) >> 12]++;
+        for (int nibble = 0; nibble < 16; nibble++) {
+            if (nibbles[nibble] != 0) {
+                out << "    chip8.stats.opcodes[" << hex(nibble, 1) << "] += " << nibbles[nibble] << ";\n";
+            }
+        }
+        if (include_last && (fetch(end) >> 12) == 0xE) out << "    chip8.stats.input_polls++;\n";
+
+        for (std::uint16_t address = start; address < end; address += 2) {
+            emit_straight(out, address, fetch(address));
+        }
+
+        if (!include_last) {
+            out << "    " << go_to(end) << "\n";
+            return;
+        }
+
+        std::uint16_t opcode = fetch(end);
+        std::uint8_t x = (opcode >> 8) & 0xF;
+        std::uint8_t y = (opcode >> 4) & 0xF;
+        std::uint8_t nn = opcode & 0xFF;
+        std::uint16_t nnn = opcode & 0xFFF;
+        if (classify(opcode) != Kind::Store) out << "    // " << hex(end) << ": " << hex(opcode, 4) << "\n";
+        switch (classify(opcode)) {
+            case Kind::Store:
+                emit_straight(out, end, opcode);
+                out << "    " << go_to(end + 2) << "\n";
+                break;
+            case Kind::Jump:
+                // a short loop back goes through run_frame(), which skips it when it is idle
+                if (nnn < end + 2 && end + 2 - nnn <= 16) {
+                    out << "    chip8.PC = " << hex(nnn) << "; chip8.mark_loop_candidate(); return executed;\n";
+                } else {
+                    out << "    " << go_to(nnn) << "\n";
+                }
+                break;
+            case Kind::Call:
+                out << "    chip8.stack[chip8.stack_pointer] = " << hex(end + 2) << ";\n"
+                    << "    chip8.stack_pointer = (chip8.stack_pointer + 1) & 0xF;\n"
+                    << "    " << go_to(nnn) << "\n";
+                break;
+            case Kind::Return:
+                out << "    chip8.stack_pointer = (chip8.stack_pointer - 1) & 0xF;\n"
+                    << "    chip8.PC = chip8.stack[chip8.stack_pointer];\n"
+                    << "    goto dispatch;\n";
+                uses_dispatch_ = true;
+                break;
+            case Kind::Skip: {
+                std::string condition;
+                switch (opcode >> 12) {
+                    case 0x3: condition = "V[" + hex(x, 1) + "] == " + hex(nn, 2); break;
+                    case 0x4: condition = "V[" + hex(x, 1) + "] != " + hex(nn, 2); break;
+                    case 0x5: condition = "V[" + hex(x, 1) + "] == V[" + hex(y, 1) + "]"; break;
+                    case 0x9: condition = "V[" + hex(x, 1) + "] != V[" + hex(y, 1) + "]"; break;
+                    default:
+                        condition = std::string(nn == 0x9E ? "" : "!") + "chip8.keys[V[" + hex(x, 1) + "] & 0xF]";
+                        break;
+                }
+                out << "    if (" << condition << ") { " << go_to(end + 4) << " }\n"
+                    << "    " << go_to(end + 2) << "\n";
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void emit_straight(std::ostringstream &out, std::uint16_t address, std::uint16_t opcode) {
+        std::string X = hex((opcode >> 8) & 0xF, 1);
+        std::string Y = hex((opcode >> 4) & 0xF, 1);
+        std::string N = hex(opcode & 0xF, 1);
+        std::string NN = hex(opcode & 0xFF, 2);
+        std::string NNN = hex(opcode & 0xFFF);
+
+        out << "    // " << hex(address) << ": " << hex(opcode, 4) << "\n";
+        switch (opcode >> 12) {
+            case 0x0:
+                if (opcode == 0x00E0) {
+                    out << "    chip8.clear_screen();\n";
+                }
+                break;
+            case 0x6:
+                out << "    V[" << X << "] = " << NN << ";\n";
+                break;
+            case 0x7:
+                out << "    V[" << X << "] += " << NN << ";\n";
+                break;
+            case 0x8:
+                switch (opcode & 0xF) {
+                    case 0x0: out << "    V[" << X << "] = V[" << Y << "];\n"; break;
+                    case 0x1: out << "    V[" << X << "] |= V[" << Y << "];\n"; break;
+                    case 0x2: out << "    V[" << X << "] &= V[" << Y << "];\n"; break;
+                    case 0x3: out << "    V[" << X << "] ^= V[" << Y << "];\n"; break;
+                    // flag results depend on register aliasing and quirks, keep the shared semantics
+                    case 0x4: case 0x5: case 0x6: case 0x7: case 0xE:
+                        out << "    chip8.arithmetic(" << X << ", " << Y << ", " << N << ");\n";
+                        break;
+                }
+                break;
+            case 0xA:
+                out << "    chip8.index_register = " << NNN << ";\n";
+                break;
+            case 0xC:
+                out << "    V[" << X << "] = chip8.random_byte() & " << NN << ";\n";
+                break;
+            case 0xD:
+                out << "    chip8.draw_sprite(" << X << ", " << Y << ", " << N << ");\n";
+                break;
+            case 0xF:
+                switch (opcode & 0xFF) {
+                    case 0x02:
+                        out << "    chip8.load_audio_pattern();\n";
+                        break;
+                    case 0x07: out << "    V[" << X << "] = chip8.delay_timer;\n"; break;
+                    case 0x15: out << "    chip8.delay_timer = V[" << X << "];\n"; break;
+                    case 0x18: out << "    chip8.sound_timer = V[" << X << "];\n"; break;
+                    case 0x1E: out << "    chip8.index_register += V[" << X << "];\n"; break;
+                    case 0x29: out << "    chip8.index_register = 0x050 + V[" << X << "] * 5;\n"; break;
+                    case 0x33: out << "    chip8.store_bcd(" << X << ");\n"; break;
+                    case 0x3A: out << "    chip8.audio_pitch = V[" << X << "];\n"; break;
+                    case 0x55: out << "    chip8.store_registers(" << X << ");\n"; break;
+                    case 0x65: out << "    chip8.load_registers(" << X << ");\n"; break;
+                }
+                break;
+        }
+    }
+
+    const std::vector<std::uint8_t> &rom_;
+    std::set<std::uint16_t> starts_;
+    // set once a block returns through the dispatch switch
+    bool uses_dispatch_ = false;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help") {
+        std::cerr << "Usage: " << argv[0] << " <rom> [-o <out.cpp>]\n"
+                  << "Writes C++ source implementing aot.h for the rom, to stdout unless -o is given"
+                  << std::endl;
+        return argc < 2 ? 1 : 0;
+    }
+
+    std::string out_path;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) out_path = argv[++i];
+    }
+
+    std::ifstream input(argv[1], std::ios::binary);
+    if (!input) {
+        std::cerr << "could not open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<std::uint8_t> rom(std::istreambuf_iterator<char>(input), {});
+    if (rom.empty() || rom.size() > 4096 - 0x200) {
+        std::cerr << argv[1] << " is not a chip8 rom (" << rom.size() << " bytes)" << std::endl;
+        return 1;
+    }
+
+    Compiler compiler(rom);
+    compiler.discover();
+    std::string source = compiler.generate(argv[1]);
+
+    if (out_path.empty()) {
+        std::cout << source;
+    } else {
+        std::ofstream out(out_path, std::ios::binary);
+        out << source;
+        if (!out) {
+            std::cerr << "failed to write " << out_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
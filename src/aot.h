@@ -0,0 +1,18 @@
+#ifndef CHIP8_EMULATOR_AOT_H
+#define CHIP8_EMULATOR_AOT_H
+#include <cstddef>
+#include <cstdint>
+#include "chip8.h"
+
+// Symbols defined by the C++ source chip8-aot generates for a rom. The
+// frontend is built with CHIP8_AOT defined and linked against that source to
+// ship a single game with no decode overhead.
+
+// the rom the code was compiled from, loaded at 0x200 as usual
+extern const std::uint8_t chip8_aot_rom[];
+extern const std::size_t chip8_aot_rom_size;
+
+// Chip8::native_code entry point. Blocks whose bytes no longer match the rom
+// (self modifying code) and computed BNNN targets fall back to the interpreter.
+int chip8_aot_run(Chip8 &chip8, int budget);
+#endif //CHIP8_EMULATOR_AOT_H
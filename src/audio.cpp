@@ -0,0 +1,40 @@
+#include <cmath>
+#include "audio.h"
+
+static const std::int16_t volume = 3000;
+
+Beeper::Beeper(SampleRing &ring, int sample_rate, std::size_t max_latency_samples)
+    : ring_(ring), sample_rate_(sample_rate), max_latency_samples_(max_latency_samples) {}
+
+void Beeper::emit(const Chip8 &chip8, std::uint32_t elapsed, std::uint32_t per_second) {
+    remainder_ += (std::uint64_t)elapsed * sample_rate_;
+    std::uint64_t count = remainder_ / per_second;
+    remainder_ %= per_second;
+
+    bool on = chip8.sound_timer > 0;
+    // pattern bits per second, 4000 at the default pitch of 64
+    double step = 4000.0 * std::pow(2.0, (chip8.audio_pitch - 64) / 48.0) / sample_rate_;
+
+    std::int16_t chunk[256];
+    while (count > 0) {
+        std::size_t n = count < 256 ? (std::size_t)count : 256;
+        // MegaChip digitized sound takes over from the buzzer while it plays
+        bool digitized = chip8.megachip != nullptr && chip8.megachip->render_sound(chunk, n, sample_rate_);
+        for (std::size_t i = 0; i < n && !digitized; i++) {
+            if (on) {
+                int bit = (int)phase_;
+                bool high = (chip8.audio_pattern[bit >> 3] >> (7 - (bit & 7))) & 1;
+                chunk[i] = high ? volume : -volume;
+                phase_ += step;
+                if (phase_ >= 128) phase_ -= 128;
+            } else {
+                chunk[i] = 0;
+            }
+        }
+        count -= n;
+
+        std::size_t room = ring_.size() < max_latency_samples_ ? max_latency_samples_ - ring_.size() : 0;
+        std::size_t written = ring_.write(chunk, n < room ? n : room);
+        dropped_ += n - written;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef CHIP8_EMULATOR_AUDIO_H
+#define CHIP8_EMULATOR_AUDIO_H
+#include <cstdint>
+#include "chip8.h"
+#include "ring_buffer.h"
+
+using SampleRing = RingBuffer<std::int16_t, 4096>;
+
+// Turns the sound timer into samples for the audio device. The machine's
+// 128 bit audio pattern is played back at the XO-CHIP pitch rate; the default
+// pattern makes this a plain square wave beep for ordinary chip8 roms.
+class Beeper {
+public:
+    Beeper(SampleRing &ring, int sample_rate, std::size_t max_latency_samples);
+
+    // Emit the samples covering `elapsed` out of `per_second` units of emulated
+    // time. Fractions of a sample carry over so the output stays sample
+    // accurate however the caller slices time. Samples beyond the latency cap
+    // are dropped rather than waited on.
+    void emit(const Chip8 &chip8, std::uint32_t elapsed, std::uint32_t per_second);
+
+    std::uint64_t dropped_samples() const { return dropped_; }
+
+private:
+    SampleRing &ring_;
+    int sample_rate_;
+    std::size_t max_latency_samples_;
+    std::uint64_t remainder_ = 0;
+    double phase_ = 0;
+    std::uint64_t dropped_ = 0;
+};
+#endif //CHIP8_EMULATOR_AUDIO_H
@@ -0,0 +1,236 @@
+#include "block_cache.h"
+#include "chip8.h"
+
+static const std::size_t op_pool_size = 16384;
+
+// first nibble of the opcode each op decodes, for RuntimeStats::opcodes;
+// fused ops count their second instruction where they run
+static const std::uint8_t op_nibble[] = {
+        0x0, 0x6, 0x7, 0x8, 0xA, 0xC, 0xD,
+        0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+        0xF, 0xF,
+        0xA, 0xA, 0x6
+};
+
+BlockCache::BlockCache() {
+    ops_.reserve(op_pool_size);
+}
+
+void BlockCache::clear() {
+    blocks_.fill({});
+    hotness_.fill(0);
+    code_pages_ = 0;
+    ops_.clear();
+}
+
+bool BlockCache::compile(const Chip8 &chip8, std::uint16_t pc) {
+    if (ops_.size() + max_block_length > op_pool_size) {
+        clear();
+    }
+
+    std::uint32_t first = (std::uint32_t)ops_.size();
+    int instructions = 0;
+    std::uint16_t address = pc;
+
+    while (instructions < max_block_length && address < 0xFFF) {
+        std::uint16_t opcode = (chip8.memory[address] << 8) | chip8.memory[address + 1];
+        std::uint8_t x = (opcode >> 8) & 0xF;
+        std::uint8_t y = (opcode >> 4) & 0xF;
+        std::uint8_t n = opcode & 0xF;
+        std::uint8_t nn = opcode & 0xFF;
+        std::uint16_t nnn = opcode & 0xFFF;
+
+        bool decoded = true;
+        bool ends_block = false;
+        DecodedOp op{Op::Clear, x, y, n, nnn};
+        switch (opcode >> 12) {
+            case 0x0:
+                decoded = opcode == 0x00E0;
+                break;
+            case 0x6:
+                op = {Op::Load, x, y, nn, nnn};
+                break;
+            case 0x7:
+                op = {Op::Add, x, y, nn, nnn};
+                break;
+            case 0x8:
+                op.op = Op::Arithmetic;
+                decoded = n <= 0x7 || n == 0xE;
+                break;
+            case 0xA:
+                op.op = Op::Index;
+                break;
+            case 0xC:
+                op = {Op::Random, x, y, nn, nnn};
+                break;
+            case 0xD:
+                op.op = Op::Draw;
+                break;
+            case 0xF:
+                switch (nn) {
+                    case 0x02: op.op = Op::Pattern; break;
+                    case 0x07: op.op = Op::ReadDelay; break;
+                    case 0x15: op.op = Op::SetDelay; break;
+                    case 0x18: op.op = Op::SetSound; break;
+                    case 0x1E: op.op = Op::AddIndex; break;
+                    case 0x29: op.op = Op::Font; break;
+                    case 0x3A: op.op = Op::Pitch; break;
+                    case 0x65: op.op = Op::LoadRegisters; break;
+                    // a store can rewrite the instructions after it
+                    case 0x33: op.op = Op::Bcd; ends_block = true; break;
+                    case 0x55: op.op = Op::Store; ends_block = true; break;
+                    default: decoded = false; break;
+                }
+                break;
+            default:
+                // jumps, calls, skips and key checks stay in the interpreter
+                decoded = false;
+                break;
+        }
+        if (!decoded) break;
+
+        // fuse with the previous op where a superinstruction exists
+        DecodedOp *previous = ops_.size() > first ? &ops_.back() : nullptr;
+        if (previous != nullptr && previous->op == Op::Index && op.op == Op::Draw) {
+            *previous = {Op::IndexDraw, x, y, n, previous->nnn};
+        } else if (previous != nullptr && previous->op == Op::Index && op.op == Op::LoadRegisters) {
+            *previous = {Op::IndexLoad, x, y, n, previous->nnn};
+        } else if (previous != nullptr && previous->op == Op::Load) {
+            // the second register and value ride in y and nnn
+            if (op.op == Op::Load) {
+                *previous = {Op::LoadPair, previous->x, x, previous->n, nn};
+            } else {
+                ops_.push_back(op);
+            }
+        } else {
+            ops_.push_back(op);
+        }
+
+        instructions++;
+        address += 2;
+        if (ends_block) break;
+    }
+
+    if (instructions == 0) return false;
+
+    blocks_[pc] = {first, (std::uint8_t)(ops_.size() - first), (std::uint8_t)instructions};
+    for (int page = pc / 64; page <= (pc + instructions * 2 - 1) / 64; page++) {
+        code_pages_ |= std::uint64_t(1) << page;
+    }
+    promotions++;
+    return true;
+}
+
+int BlockCache::run(Chip8 &chip8, int budget) {
+    if (chip8.PC > 0xFFF) return 0;
+    std::uint16_t pc = chip8.PC;
+
+    if (blocks_[pc].length == 0) {
+        if (hotness_[pc] == 0xFFFF) return 0;
+        if (++hotness_[pc] < hot_threshold) return 0;
+        if (!compile(chip8, pc)) {
+            hotness_[pc] = 0xFFFF;
+            return 0;
+        }
+    }
+
+    // copied, a store at the end of the block may demote it while it runs
+    Block block = blocks_[pc];
+    if (block.instructions > budget) return 0;
+
+    for (std::uint32_t i = block.first; i < block.first + block.length; i++) {
+        const DecodedOp &op = ops_[i];
+        chip8.stats.opcodes[op_nibble[(int)op.op]]++;
+        switch (op.op) {
+            case Op::Clear:
+                chip8.clear_screen();
+                break;
+            case Op::Load:
+                chip8.gpv_registers[op.x] = op.n;
+                break;
+            case Op::Add:
+                chip8.gpv_registers[op.x] += op.n;
+                break;
+            case Op::Arithmetic:
+                chip8.arithmetic(op.x, op.y, op.n);
+                break;
+            case Op::Index:
+                chip8.index_register = op.nnn;
+                break;
+            case Op::Random:
+                chip8.gpv_registers[op.x] = chip8.random_byte() & op.n;
+                break;
+            case Op::Draw:
+                chip8.draw_sprite(op.x, op.y, op.n);
+                break;
+            case Op::ReadDelay:
+                chip8.gpv_registers[op.x] = chip8.delay_timer;
+                break;
+            case Op::SetDelay:
+                chip8.delay_timer = chip8.gpv_registers[op.x];
+                break;
+            case Op::SetSound:
+                chip8.sound_timer = chip8.gpv_registers[op.x];
+                break;
+            case Op::AddIndex:
+                chip8.index_register += chip8.gpv_registers[op.x];
+                break;
+            case Op::Font:
+                chip8.index_register = 0x050 + chip8.gpv_registers[op.x] * 5;
+                break;
+            case Op::Bcd:
+                chip8.store_bcd(op.x);
+                break;
+            case Op::Store:
+                chip8.store_registers(op.x);
+                break;
+            case Op::LoadRegisters:
+                chip8.load_registers(op.x);
+                break;
+            case Op::Pattern:
+                chip8.load_audio_pattern();
+                break;
+            case Op::Pitch:
+                chip8.audio_pitch = chip8.gpv_registers[op.x];
+                break;
+            case Op::IndexDraw:
+                chip8.stats.opcodes[0xD]++;
+                chip8.index_register = op.nnn;
+                chip8.draw_sprite(op.x, op.y, op.n);
+                break;
+            case Op::IndexLoad:
+                chip8.stats.opcodes[0xF]++;
+                chip8.index_register = op.nnn;
+                chip8.load_registers(op.x);
+                break;
+            case Op::LoadPair:
+                chip8.stats.opcodes[0x6]++;
+                chip8.gpv_registers[op.x] = op.n;
+                chip8.gpv_registers[op.y] = (std::uint8_t)op.nnn;
+                break;
+        }
+    }
+
+    chip8.PC = pc + block.instructions * 2;
+    block_cycles += block.instructions;
+    return block.instructions;
+}
+
+void BlockCache::invalidate(int address, int length) {
+    for (int offset = 0; offset < length; offset++) {
+        int written = (address + offset) & 0xFFF;
+        // the count was for what used to be here, whether or not it made a block yet
+        hotness_[written] = 0;
+        if (((code_pages_ >> (written / 64)) & 1) == 0) continue;
+
+        for (int start = written - (max_block_length * 2 - 1); start <= written; start++) {
+            if (start < 0) continue;
+            Block &block = blocks_[start];
+            if (block.length != 0 && start + block.instructions * 2 > written) {
+                block = {};
+                hotness_[start] = 0;
+                demotions++;
+            }
+        }
+    }
+}
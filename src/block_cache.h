@@ -0,0 +1,72 @@
+#ifndef CHIP8_EMULATOR_BLOCK_CACHE_H
+#define CHIP8_EMULATOR_BLOCK_CACHE_H
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct Chip8;
+
+// Second execution tier. Every address starts out in the interpreter, which
+// counts how often it is reached; once an address turns hot, the straight
+// line run of instructions starting there is decoded once (with the
+// superinstruction pairs fused) and replayed from then on. Blocks stop before
+// any instruction that can change control flow and right after any store, so
+// the interpreter still handles every jump, skip and wait. Stores that land in
+// compiled code drop the blocks they overlap back to the interpreter.
+// Native code is only available ahead of time, per rom, through chip8-aot.
+class BlockCache {
+public:
+    // interpreter visits before the block starting at an address is compiled
+    static constexpr std::uint16_t hot_threshold = 32;
+    static constexpr int max_block_length = 32;
+
+    BlockCache();
+
+    // Runs the compiled block at chip8.PC if there is one that fits in
+    // `budget` instructions, compiling it first once the address is hot.
+    // Returns the number of instructions run, 0 leaves the next one to step().
+    int run(Chip8 &chip8, int budget);
+
+    // demote every block overlapping memory[address, address + length)
+    void invalidate(int address, int length);
+    void clear();
+
+    // blocks compiled, blocks dropped by stores, and instructions run from blocks
+    std::uint64_t promotions = 0;
+    std::uint64_t demotions = 0;
+    std::uint64_t block_cycles = 0;
+
+private:
+    enum class Op : std::uint8_t {
+        Clear, Load, Add, Arithmetic, Index, Random, Draw,
+        ReadDelay, SetDelay, SetSound, AddIndex, Font, Bcd, Store, LoadRegisters,
+        Pattern, Pitch,
+        IndexDraw, IndexLoad, LoadPair
+    };
+
+    struct DecodedOp {
+        Op op;
+        std::uint8_t x;
+        std::uint8_t y;
+        std::uint8_t n;
+        std::uint16_t nnn;
+    };
+
+    struct Block {
+        std::uint32_t first = 0;
+        // decoded ops, and the instructions they cover; 0 means not compiled
+        std::uint8_t length = 0;
+        std::uint8_t instructions = 0;
+    };
+
+    bool compile(const Chip8 &chip8, std::uint16_t pc);
+
+    std::array<Block, 4096> blocks_{};
+    // saturates at 0xFFFF for addresses where no block can start
+    std::array<std::uint16_t, 4096> hotness_{};
+    // bit n set once a block covers memory[n * 64, n * 64 + 64)
+    std::uint64_t code_pages_ = 0;
+    // all decoded ops, reserved up front and flushed when full so compiling never allocates
+    std::vector<DecodedOp> ops_;
+};
+#endif //CHIP8_EMULATOR_BLOCK_CACHE_H
@@ -0,0 +1,141 @@
+#include "chip8.h"
+
+// Conformance roms run by the compiler. The core is constexpr, so a change in
+// opcode semantics, or in a superinstruction that no longer matches the plain
+// instructions it replaces, fails the build instead of a test run.
+
+namespace {
+
+template <std::size_t N>
+constexpr Chip8 run_program(const std::array<std::uint16_t, N> &program, int instructions,
+                            bool chip48_mode = true, bool fuse = false, bool vip_timing = false) {
+    std::array<std::uint8_t, N * 2> rom{};
+    for (std::size_t i = 0; i < N; i++) {
+        rom[i * 2] = program[i] >> 8;
+        rom[i * 2 + 1] = program[i] & 0xFF;
+    }
+
+    Chip8 chip8;
+    chip8.reset();
+    chip8.chip48_mode = chip48_mode;
+    chip8.fuse = fuse;
+    chip8.vip_timing = vip_timing;
+    chip8.skip_idle_loops = false;
+    chip8.load_rom(rom.data(), rom.size());
+    chip8.run_frame(instructions);
+    return chip8;
+}
+
+// `frames` frames of `ipf` instructions with idle loop skipping on or off
+template <std::size_t N>
+constexpr Chip8 run_frames(const std::array<std::uint16_t, N> &program, int frames, int ipf, bool skip_idle_loops,
+                           bool vip_timing = false) {
+    Chip8 chip8 = run_program(program, 0);
+    chip8.skip_idle_loops = skip_idle_loops;
+    chip8.vip_timing = vip_timing;
+    for (int frame = 0; frame < frames; frame++) chip8.run_frame(ipf);
+    return chip8;
+}
+
+constexpr bool same_state(const Chip8 &a, const Chip8 &b) {
+    for (int x = 0; x < 64; x++) {
+        for (int y = 0; y < 32; y++) {
+            if (a.screen[x][y] != b.screen[x][y]) return false;
+        }
+    }
+    return a.memory == b.memory && a.gpv_registers == b.gpv_registers && a.index_register == b.index_register &&
+           a.stack == b.stack && a.stack_pointer == b.stack_pointer && a.PC == b.PC;
+}
+
+// FX33 of 156 to 0x300, read back with F265
+constexpr Chip8 bcd = run_program(std::array<std::uint16_t, 4>{0x6A9C, 0xA300, 0xFA33, 0xF265}, 4);
+static_assert(bcd.memory[0x300] == 1 && bcd.memory[0x301] == 5 && bcd.memory[0x302] == 6);
+static_assert(bcd.gpv_registers[0] == 1 && bcd.gpv_registers[1] == 5 && bcd.gpv_registers[2] == 6);
+
+// 8XY4 carry
+constexpr Chip8 add_carry = run_program(std::array<std::uint16_t, 3>{0x60FF, 0x6102, 0x8014}, 3);
+static_assert(add_carry.gpv_registers[0] == 0x01 && add_carry.gpv_registers[0xF] == 1);
+constexpr Chip8 add_no_carry = run_program(std::array<std::uint16_t, 3>{0x6010, 0x6120, 0x8014}, 3);
+static_assert(add_no_carry.gpv_registers[0] == 0x30 && add_no_carry.gpv_registers[0xF] == 0);
+
+// 8XY5 and 8XY7 borrow, VF is 1 when there is none
+constexpr Chip8 sub = run_program(std::array<std::uint16_t, 3>{0x6005, 0x6103, 0x8015}, 3);
+static_assert(sub.gpv_registers[0] == 0x02 && sub.gpv_registers[0xF] == 1);
+constexpr Chip8 sub_borrow = run_program(std::array<std::uint16_t, 3>{0x6003, 0x6105, 0x8015}, 3);
+static_assert(sub_borrow.gpv_registers[0] == 0xFE && sub_borrow.gpv_registers[0xF] == 0);
+constexpr Chip8 subn = run_program(std::array<std::uint16_t, 3>{0x6003, 0x6105, 0x8017}, 3);
+static_assert(subn.gpv_registers[0] == 0x02 && subn.gpv_registers[0xF] == 1);
+constexpr Chip8 subn_borrow = run_program(std::array<std::uint16_t, 3>{0x6005, 0x6103, 0x8017}, 3);
+static_assert(subn_borrow.gpv_registers[0] == 0xFE && subn_borrow.gpv_registers[0xF] == 0);
+// equal operands don't borrow either
+static_assert(run_program(std::array<std::uint16_t, 2>{0x6005, 0x8005}, 2).gpv_registers[0xF] == 1);
+static_assert(run_program(std::array<std::uint16_t, 2>{0x6005, 0x8007}, 2).gpv_registers[0xF] == 1);
+
+// VF as an operand: the result is worked out from its old value, and the
+// flag is written last, so with X = F it overwrites the result
+constexpr Chip8 add_into_vf = run_program(std::array<std::uint16_t, 3>{0x6F10, 0x6120, 0x8F14}, 3);
+static_assert(add_into_vf.gpv_registers[0xF] == 0);
+constexpr Chip8 sub_from_vf = run_program(std::array<std::uint16_t, 3>{0x6005, 0x6F03, 0x80F5}, 3);
+static_assert(sub_from_vf.gpv_registers[0] == 0x02 && sub_from_vf.gpv_registers[0xF] == 1);
+static_assert(run_program(std::array<std::uint16_t, 2>{0x6F81, 0x8F06}, 2).gpv_registers[0xF] == 1);
+static_assert(run_program(std::array<std::uint16_t, 2>{0x6F81, 0x8F0E}, 2).gpv_registers[0xF] == 1);
+
+// 8XY6 and 8XYE shift VX in place by default, and shift VY into VX in -chip48 (VIP) mode
+constexpr std::array<std::uint16_t, 3> shift_right = {0x6005, 0x6180, 0x8016};
+static_assert(run_program(shift_right, 3).gpv_registers[0] == 0x02);
+static_assert(run_program(shift_right, 3).gpv_registers[0xF] == 1);
+static_assert(run_program(shift_right, 3, false).gpv_registers[0] == 0x40);
+static_assert(run_program(shift_right, 3, false).gpv_registers[0xF] == 0);
+constexpr std::array<std::uint16_t, 3> shift_left = {0x6081, 0x6140, 0x801E};
+static_assert(run_program(shift_left, 3).gpv_registers[0] == 0x02);
+static_assert(run_program(shift_left, 3).gpv_registers[0xF] == 1);
+static_assert(run_program(shift_left, 3, false).gpv_registers[0] == 0x80);
+static_assert(run_program(shift_left, 3, false).gpv_registers[0xF] == 0);
+
+// idle loop skipping never changes results: a loop whose jump leads out to
+// code that does work is not idle, however short it is
+constexpr std::array<std::uint16_t, 5> jump_out = {0x1206, 0x6005, 0x1200, 0x7101, 0x1200};
+static_assert(run_frames(jump_out, 60, 12, false).gpv_registers[1] == 240);
+static_assert(run_frames(jump_out, 60, 12, true).gpv_registers[1] == 240);
+static_assert(run_frames(jump_out, 60, 12, true).elided_cycles == 0);
+
+// F002 reads its 16 byte pattern through the read watchpoints like FX65
+constexpr Chip8 watched_pattern() {
+    Chip8 chip8 = run_program(std::array<std::uint16_t, 2>{0xA30A, 0xF002}, 0);
+    chip8.set_watch(0x315, true, false);
+    chip8.run_frame(2);
+    return chip8;
+}
+static_assert(watched_pattern().watch_hits == 1 && watched_pattern().watch_address == 0x315);
+
+// every superinstruction, including a CountLoop that exits, against plain step()
+constexpr std::array<std::uint16_t, 10> fusable = {
+        0x6000, 0x6108,             // LoadPair
+        0x7001, 0x3005, 0x1204,     // CountLoop until V0 is 5
+        0xA050, 0xD015,             // IndexDraw
+        0xA300, 0xF165,             // IndexLoad
+        0x1212
+};
+static_assert(same_state(run_program(fusable, 40, true, true), run_program(fusable, 40)));
+static_assert(run_program(fusable, 40, true, true).gpv_registers[0] == 0 &&
+              run_program(fusable, 40, true, true).screen[5][8]);
+
+// DXYN costs two cycles a byte for every row, which outgrows a byte from 15 rows
+static_assert(vip_instruction_cycles(0xD01E) == 250);
+static_assert(vip_instruction_cycles(0xD01F) == 266);
+
+// VIP timing: 7001 and 1200 cost 33 cycles a pass, so 81 increments fit in a
+// frame, and DXYN ends the frame it is reached in
+constexpr std::array<std::uint16_t, 2> vip_count = {0x7001, 0x1200};
+static_assert(run_program(vip_count, 0, true, false, true).gpv_registers[0] == 81);
+static_assert(run_program(vip_count, 0, true, false, true).vip_cycle_debt == 6);
+constexpr std::array<std::uint16_t, 3> vip_draw = {0xD001, 0x7001, 0x1200};
+static_assert(run_program(vip_draw, 0, true, false, true).gpv_registers[0] == 0);
+static_assert(run_program(vip_draw, 0, true, false, true).PC == 0x202);
+// a skipped idle loop counts the instructions it would have run as elided
+constexpr std::array<std::uint16_t, 2> vip_idle = {0x7001, 0x1202};
+static_assert(run_frames(vip_idle, 3, 0, true, true).elided_cycles > 0);
+static_assert(run_frames(vip_idle, 3, 0, true, true).cycle_count + run_frames(vip_idle, 3, 0, true, true).elided_cycles ==
+              run_frames(vip_idle, 3, 0, false, true).cycle_count);
+
+}
@@ -0,0 +1,863 @@
+#ifndef CHIP8_EMULATOR_CHIP8_H
+#define CHIP8_EMULATOR_CHIP8_H
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include "block_cache.h"
+#include "megachip.h"
+#include "stats.h"
+#include "utils.h"
+
+// Interpreter state and opcode semantics, kept free of SDL so the same core
+// drives the windowed frontend and the headless runner. Everything here is
+// constexpr so small roms can be run inside static_assert, see chip8.cpp.
+
+// Superinstructions for common opcode sequences, see Chip8::fuse
+enum class Fused : std::uint8_t {
+    None,
+    IndexDraw,          // ANNN; DXYN
+    IndexLoad,          // ANNN; FX65
+    LoadPair,           // 6XNN; 6YNN
+    CountLoop,          // 7XNN; 3XNN; 1NNN
+};
+
+// loaded at 0x050 by reset()
+inline constexpr std::array<std::uint8_t, 80> chip8_font = {
+        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+        0x20, 0x60, 0x20, 0x20, 0x70, // 1
+        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+// FX33 digits for every byte value, so the store is three table loads
+inline constexpr std::array<std::array<std::uint8_t, 3>, 256> bcd_table = [] {
+    std::array<std::array<std::uint8_t, 3>, 256> table{};
+    for (int i = 0; i < 256; i++) {
+        table[i] = {(std::uint8_t)(i / 100), (std::uint8_t)(i / 10 % 10), (std::uint8_t)(i % 10)};
+    }
+    return table;
+}();
+
+// COSMAC VIP timing, in CDP1802 machine cycles (8 clocks at 1.76 MHz, about 4.5 us)
+inline constexpr int vip_frame_cycles = 3668;
+// taken from every frame by the display DMA, 8 bytes for each of 128 scanlines
+inline constexpr int vip_display_cycles = 1024;
+// extra cost of a skip that is taken
+inline constexpr int vip_skip_cycles = 2;
+
+// What the VIP interpreter spends on an opcode, not counting DXYN's wait for
+// the display interrupt. Costs follow the commonly quoted VIP measurements.
+constexpr std::uint16_t vip_instruction_cycles(std::uint16_t opcode) {
+    std::uint8_t x = (opcode >> 8) & 0xF;
+    switch (opcode >> 12) {
+        case 0x0: return opcode == 0x00E0 ? 24 : 23;
+        case 0x1: case 0x2: case 0xB: return 23;
+        case 0x3: case 0x4: case 0xA: return 12;
+        case 0x5: case 0x9: case 0xE: return 16;
+        case 0x6: return 6;
+        case 0x7: return 10;
+        case 0x8: return 44;
+        case 0xC: return 36;
+        // plus two cycles a byte for every row drawn
+        case 0xD: return 26 + (opcode & 0xF) * 2 * 8;
+        default:
+            switch (opcode & 0xFF) {
+                case 0x1E: return 19;
+                case 0x29: return 20;
+                case 0x33: return 204;
+                case 0x55: case 0x65: return 14 + 14 * (x + 1);
+                default: return 10;
+            }
+    }
+}
+
+struct Chip8;
+
+// The hooks run_frame() is instantiated with outside a debugger. A debugger
+// provides the same members with `active` set: before_step() is called with
+// PC at the next instruction and after_step() once it has run, either
+// returning true ends the frame there. While active every instruction goes
+// through step(), so no superinstruction, block or native code runs past a hook.
+struct NoHooks {
+    static constexpr bool active = false;
+    constexpr bool before_step(const Chip8 &) { return false; }
+    constexpr bool after_step(const Chip8 &) { return false; }
+};
+
+struct Chip8 {
+    // 4Kb of memory
+    std::array<std::uint8_t, 4096> memory{};
+
+    // general-purpose variable registers
+    std::array<std::uint8_t, 16> gpv_registers{};
+
+    std::uint16_t index_register = 0;
+    std::uint8_t delay_timer = 0;
+    std::uint8_t sound_timer = 0;
+    std::array<std::uint16_t, 16> stack{};
+    std::uint8_t stack_pointer = 0;
+    std::uint16_t PC = 0x200;
+
+    bool screen[64][32]{};
+
+    // keypad state, indexed by chip8 key value (0x0 - 0xF), written by the frontend
+    bool keys[16]{};
+
+    // XO-CHIP audio pattern (F002) and pitch (FX3A), the default pattern is a square wave
+    std::uint8_t audio_pattern[16]{};
+    std::uint8_t audio_pitch = 64;
+
+    // CXNN random source, a per machine xorshift rather than rand() so runs are
+    // reproducible and can happen in constant expressions
+    std::uint32_t random_state = 0x2545F491;
+
+    bool chip48_mode = true;
+
+    // set by 00E0 and DXYN, cleared by whoever presents the screen
+    bool draw_flag = false;
+
+    // end a frame early once the rom is spinning in a loop that can only exit
+    // when the timers tick or the keypad changes, both of which happen between frames
+    bool skip_idle_loops = true;
+
+    // run_frame() executes common opcode sequences as one superinstruction.
+    // A sequence is only fused when the whole of it fits in the frame, so the
+    // machine state between frames is the same as without fusion, and step()
+    // always executes exactly one instruction.
+    bool fuse = false;
+
+    // superinstruction starting at each address, kept up to date across memory writes
+    std::array<Fused, 4096> fusion{};
+
+    // run_frame() runs as many instructions as fit in a VIP frame at their VIP
+    // cycle costs instead of a fixed count, and DXYN waits for the next frame
+    // like the VIP's display interrupt makes it. Every instruction goes through
+    // step(), the other tiers are not used.
+    bool vip_timing = false;
+
+    // VIP cycles of the instruction at each address, kept up to date with fusion
+    std::array<std::uint16_t, 4096> vip_cost{};
+
+    // cycles already spent in the next frame by the instruction that ended this one
+    int vip_cycle_debt = 0;
+
+    // optional pre-decoded tier for hot code, owned by the frontend
+    BlockCache *block_cache = nullptr;
+
+    // MegaChip extension for roms too large for 4Kb, owned by the frontend.
+    // While set it runs every instruction and the other tiers are not used.
+    MegaChip *megachip = nullptr;
+
+    // optional ahead-of-time compiled rom (see chip8-aot), tried before any
+    // other tier. Runs at most `budget` instructions from PC and returns how
+    // many it ran, 0 hands the next instruction to the interpreter.
+    int (*native_code)(Chip8 &chip8, int budget) = nullptr;
+
+    // native code taking a jump of at most 8 instructions back, as 1NNN does
+    // in step(), then returning so run_frame() can look for an idle loop
+    constexpr void mark_loop_candidate() { loop_candidate = true; }
+
+    // bit n set once a store has landed in memory[n * 64, n * 64 + 64) since reset()
+    std::uint64_t written_pages = 0;
+
+    // read and write watchpoints, bit n % 64 of word n / 64 watches memory[n].
+    // Only DXYN, FX33, FX55, FX65 and F002 touch memory, and only they test these.
+    // A hit bumps watch_hits and records the first watched byte it touched.
+    std::array<std::uint64_t, 64> watch_reads{};
+    std::array<std::uint64_t, 64> watch_writes{};
+    std::uint64_t watch_hits = 0;
+    std::uint16_t watch_address = 0;
+    bool watch_write = false;
+
+    // bumped whenever memory or the screen may have changed, so state hashes
+    // only rehash those when they have to
+    std::uint64_t memory_version = 0;
+    std::uint64_t screen_version = 0;
+
+    // instructions run, and instructions skipped by idle loop detection
+    std::uint64_t cycle_count = 0;
+    std::uint64_t elided_cycles = 0;
+
+    // superinstructions run, and the instructions they covered
+    std::uint64_t fused_count = 0;
+    std::uint64_t fused_cycles = 0;
+
+    // opcode mix, draws, frames and the like, never reset by reset()
+    RuntimeStats stats;
+
+    constexpr void reset();
+    constexpr bool load_rom(const std::uint8_t *data, std::size_t size);
+    constexpr void step();
+
+    // runs an opcode whose two bytes step() has already moved PC past
+    constexpr void execute(std::uint16_t opcode);
+    constexpr void tick_timers();
+
+    // one 60hz frame: the given number of instructions followed by a timer
+    // tick, or one VIP frame's worth of cycles with vip_timing
+    constexpr void run_frame(int instructions);
+
+    // run_frame() with `hooks` called around every instruction, see NoHooks.
+    // Returns the instructions run, fewer than asked for when a hook stopped
+    // the frame, in which case the timers have not ticked yet.
+    template <typename Hooks>
+    constexpr int run_frame(int instructions, Hooks &hooks);
+
+    // recompute the fusion and VIP cost tables for sequences touching memory[from, to)
+    constexpr void analyse_fusion(int from, int to);
+
+    // opcode semantics shared by step(), superinstructions, the block tier and chip8-aot
+    constexpr void clear_screen();
+    constexpr void arithmetic(std::uint8_t X, std::uint8_t Y, std::uint8_t N);
+    constexpr void draw_sprite(std::uint8_t X, std::uint8_t Y, std::uint8_t N);
+    constexpr void store_bcd(std::uint8_t X);
+    constexpr void store_registers(std::uint8_t X);
+    constexpr void load_registers(std::uint8_t X);
+    constexpr void load_audio_pattern();
+    constexpr std::uint8_t random_byte();
+
+    // stores outside of the rom's own instructions, from a debugger
+    constexpr void write_memory(std::uint16_t address, std::uint8_t value);
+
+    // sets whether reads and writes of memory[address] are watched
+    constexpr void set_watch(std::uint16_t address, bool read, bool write);
+
+private:
+    // set by step() on a short backward jump or a blocking FX0A
+    bool loop_candidate = false;
+
+    constexpr void memory_written(int address, int length);
+
+    // notes a hit when `map` watches any of the `length` (at most 16) bytes from `address`
+    constexpr void check_watch(const std::array<std::uint64_t, 64> &map, int address, int length, bool write);
+
+    // runs the superinstruction at PC and returns how many instructions it covered
+    constexpr int step_fused(Fused kind);
+
+    constexpr void run_vip_frame();
+
+    // Called by run_frame() with loop_candidate set after `i` of its
+    // `instructions`. Returns true, counting the rest of the frame as elided,
+    // when PC has come back round an idle loop; otherwise remembers where
+    // this possible loop starts.
+    constexpr bool ends_on_idle_loop(std::uint16_t &loop_head, int &loop_start, int i, int instructions);
+
+    constexpr bool is_idle_loop(std::uint16_t head) const;
+};
+
+constexpr void Chip8::reset() {
+    memory.fill(0);
+    gpv_registers.fill(0);
+    index_register = 0;
+    delay_timer = 0;
+    sound_timer = 0;
+    stack.fill(0);
+    stack_pointer = 0;
+    written_pages = 0;
+    vip_cycle_debt = 0;
+    PC = 0x200;
+    clear_screen();
+    std::fill(std::begin(keys), std::end(keys), false);
+    draw_flag = false;
+    std::fill(std::begin(audio_pattern), std::end(audio_pattern), 0xF0);
+    audio_pitch = 64;
+    random_state = 0x2545F491;
+
+    std::copy(chip8_font.begin(), chip8_font.end(), memory.begin() + 0x050);
+    analyse_fusion(0, 4096);
+    memory_version++;
+}
+
+constexpr bool Chip8::load_rom(const std::uint8_t *data, std::size_t size) {
+    if (size > memory.size() - 0x200) return false;
+    std::copy(data, data + size, memory.begin() + 0x200);
+    analyse_fusion(0, 4096);
+    memory_version++;
+    return true;
+}
+
+constexpr void Chip8::clear_screen() {
+    for (auto &column : screen) {
+        std::fill(std::begin(column), std::end(column), false);
+    }
+    draw_flag = true;
+    screen_version++;
+}
+
+constexpr std::uint8_t Chip8::random_byte() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % UINT8_MAX;
+}
+
+constexpr void Chip8::draw_sprite(std::uint8_t X, std::uint8_t Y, std::uint8_t N) {
+    // sprites start wrapped onto the screen and are clipped at the edges
+    std::uint8_t x = gpv_registers[X] % 64;
+    std::uint8_t y = gpv_registers[Y] % 32;
+    gpv_registers[0x0F] = 0;
+    check_watch(watch_reads, index_register, N, false);
+
+    for (int i = 0; i < N && y + i < 32; i++) {
+        std::uint8_t byte = memory[(index_register + i) & 0xFFF];
+        for (int k = 0; k < 8 && x + k < 64; k++) {
+            std::uint8_t bit = get_bit(byte, k);
+            if (bit != 0) {
+                if (screen[(x + k)][y + i] == 1) {
+                    gpv_registers[0x0F] = 1;
+                }
+                screen[(x + k)][y + i] ^= 1;
+            }
+        }
+    }
+    stats.draws++;
+    stats.collisions += gpv_registers[0x0F];
+    draw_flag = true;
+    screen_version++;
+}
+
+constexpr void Chip8::arithmetic(std::uint8_t X, std::uint8_t Y, std::uint8_t N) {
+    switch (N) {
+        case 0x00: {
+            gpv_registers[X] = gpv_registers[Y];
+            break;
+        } case 0x01: {
+            gpv_registers[X] = gpv_registers[X] | gpv_registers[Y];
+            break;
+        } case 0x02: {
+            gpv_registers[X] = gpv_registers[X] & gpv_registers[Y];
+            break;
+        } case 0x03: {
+            gpv_registers[X] = gpv_registers[X] ^ gpv_registers[Y];
+            break;
+        } case 0x04: {
+            // flags are written after the result, so VF ends up the flag when X is F
+            std::uint8_t flag = (int)gpv_registers[X] + (int)gpv_registers[Y] > 255 ? 1 : 0;
+            gpv_registers[X] = gpv_registers[X] + gpv_registers[Y];
+            gpv_registers[0xF] = flag;
+            break;
+        } case 0x05: {
+            std::uint8_t flag = gpv_registers[X] >= gpv_registers[Y] ? 1 : 0;
+            gpv_registers[X] = gpv_registers[X] - gpv_registers[Y];
+            gpv_registers[0xF] = flag;
+            break;
+        } case 0x06: {
+            std::uint8_t value = chip48_mode ? gpv_registers[X] : gpv_registers[Y];
+            std::uint8_t flag = get_bit(value, 7) ? 1 : 0;
+            gpv_registers[X] = value >> 1;
+            gpv_registers[0xF] = flag;
+            break;
+        } case 0x07: {
+            std::uint8_t flag = gpv_registers[Y] >= gpv_registers[X] ? 1 : 0;
+            gpv_registers[X] = gpv_registers[Y] - gpv_registers[X];
+            gpv_registers[0xF] = flag;
+            break;
+        } case 0x0E: {
+            std::uint8_t value = chip48_mode ? gpv_registers[X] : gpv_registers[Y];
+            std::uint8_t flag = get_bit(value, 0) ? 1 : 0;
+            gpv_registers[X] = value << 1;
+            gpv_registers[0xF] = flag;
+            break;
+        }
+    }
+}
+
+constexpr void Chip8::store_bcd(std::uint8_t X) {
+    const std::array<std::uint8_t, 3> &digits = bcd_table[gpv_registers[X]];
+    for (int i = 0; i < 3; i++) {
+        memory[(index_register + i) & 0xFFF] = digits[i];
+    }
+    memory_written(index_register, 3);
+    check_watch(watch_writes, index_register, 3, true);
+}
+
+constexpr void Chip8::store_registers(std::uint8_t X) {
+    for (int i = 0; i <= X; i++) {
+        memory[(index_register + i) & 0xFFF] = gpv_registers[i];
+    }
+    memory_written(index_register, X + 1);
+    check_watch(watch_writes, index_register, X + 1, true);
+}
+
+constexpr void Chip8::load_registers(std::uint8_t X) {
+    for (int i = 0; i <= X; i++) {
+        gpv_registers[i] = memory[(index_register + i) & 0xFFF];
+    }
+    check_watch(watch_reads, index_register, X + 1, false);
+}
+
+constexpr void Chip8::load_audio_pattern() {
+    for (int i = 0; i < 16; i++) {
+        audio_pattern[i] = memory[(index_register + i) & 0xFFF];
+    }
+    check_watch(watch_reads, index_register, 16, false);
+}
+
+constexpr void Chip8::write_memory(std::uint16_t address, std::uint8_t value) {
+    memory[address & 0xFFF] = value;
+    memory_written(address & 0xFFF, 1);
+}
+
+constexpr void Chip8::set_watch(std::uint16_t address, bool read, bool write) {
+    address &= 0xFFF;
+    std::uint64_t bit = std::uint64_t(1) << (address % 64);
+    watch_reads[address / 64] = read ? watch_reads[address / 64] | bit : watch_reads[address / 64] & ~bit;
+    watch_writes[address / 64] = write ? watch_writes[address / 64] | bit : watch_writes[address / 64] & ~bit;
+}
+
+constexpr void Chip8::check_watch(const std::array<std::uint64_t, 64> &map, int address, int length, bool write) {
+    address &= 0xFFF;
+    int bit = address % 64;
+    std::uint64_t watched = map[address / 64] >> bit;
+    // the range crosses into the next word, wrapping at the end of memory
+    if (bit + length > 64) watched |= map[(address / 64 + 1) % 64] << (64 - bit);
+    watched &= (std::uint64_t(1) << length) - 1;
+    if (watched == 0) return;
+
+    watch_hits++;
+    watch_address = (address + std::countr_zero(watched)) & 0xFFF;
+    watch_write = write;
+}
+
+constexpr void Chip8::memory_written(int address, int length) {
+    // a sequence of up to three instructions starting 5 bytes earlier can include the write
+    analyse_fusion(address - 5, address + length);
+    if (block_cache != nullptr) block_cache->invalidate(address, length);
+    for (int i = 0; i < length; i++) {
+        written_pages |= std::uint64_t(1) << (((address + i) & 0xFFF) / 64);
+    }
+    memory_version++;
+}
+
+constexpr void Chip8::analyse_fusion(int from, int to) {
+    for (int address = from; address < to; address++) {
+        std::uint16_t pc = address & 0xFFF;
+        std::uint16_t first = (memory[pc] << 8) | memory[(pc + 1) & 0xFFF];
+        std::uint16_t second = (memory[(pc + 2) & 0xFFF] << 8) | memory[(pc + 3) & 0xFFF];
+        std::uint16_t third = (memory[(pc + 4) & 0xFFF] << 8) | memory[(pc + 5) & 0xFFF];
+
+        Fused kind = Fused::None;
+        if ((first & 0xF000) == 0xA000 && (second & 0xF000) == 0xD000) {
+            kind = Fused::IndexDraw;
+        } else if ((first & 0xF000) == 0xA000 && (second & 0xF0FF) == 0xF065) {
+            kind = Fused::IndexLoad;
+        } else if ((first & 0xF000) == 0x6000 && (second & 0xF000) == 0x6000) {
+            kind = Fused::LoadPair;
+        } else if ((first & 0xF000) == 0x7000 && (second & 0xF000) == 0x3000 &&
+                   (first & 0x0F00) == (second & 0x0F00) && (third & 0xF000) == 0x1000) {
+            kind = Fused::CountLoop;
+        }
+        fusion[pc] = kind;
+        vip_cost[pc] = vip_instruction_cycles(first);
+    }
+}
+
+constexpr int Chip8::step_fused(Fused kind) {
+    std::uint16_t first = (memory[PC & 0xFFF] << 8) | memory[(PC + 1) & 0xFFF];
+    std::uint16_t second = (memory[(PC + 2) & 0xFFF] << 8) | memory[(PC + 3) & 0xFFF];
+
+    switch (kind) {
+        case Fused::IndexDraw: {
+            stats.opcodes[0xA]++;
+            stats.opcodes[0xD]++;
+            index_register = first & 0x0FFF;
+            PC += 4;
+            draw_sprite((second >> 8) & 0xF, (second >> 4) & 0xF, second & 0xF);
+            return 2;
+        } case Fused::IndexLoad: {
+            stats.opcodes[0xA]++;
+            stats.opcodes[0xF]++;
+            index_register = first & 0x0FFF;
+            PC += 4;
+            load_registers((second >> 8) & 0xF);
+            return 2;
+        } case Fused::LoadPair: {
+            stats.opcodes[0x6] += 2;
+            gpv_registers[(first >> 8) & 0xF] = first & 0xFF;
+            gpv_registers[(second >> 8) & 0xF] = second & 0xFF;
+            PC += 4;
+            return 2;
+        } case Fused::CountLoop: {
+            std::uint8_t X = (first >> 8) & 0xF;
+            stats.opcodes[0x7]++;
+            stats.opcodes[0x3]++;
+            gpv_registers[X] += first & 0xFF;
+            if (gpv_registers[X] == (second & 0xFF)) {
+                // the skip jumps over the 1NNN
+                PC += 6;
+                return 2;
+            }
+            std::uint16_t third = (memory[(PC + 4) & 0xFFF] << 8) | memory[(PC + 5) & 0xFFF];
+            stats.opcodes[0x1]++;
+            PC = third & 0x0FFF;
+            return 3;
+        } case Fused::None: {
+            break;
+        }
+    }
+    return 0;
+}
+
+constexpr void Chip8::step() {
+    if (megachip != nullptr) {
+        megachip->step(*this);
+        return;
+    }
+
+    std::uint16_t opcode = (memory[PC & 0xFFF] << 8) | memory[(PC + 1) & 0xFFF];
+    PC += 2;
+    stats.opcodes[opcode >> 12]++;
+    execute(opcode);
+}
+
+constexpr void Chip8::execute(std::uint16_t opcode) {
+    std::uint8_t byte_one = opcode >> 8;
+    std::uint8_t byte_two = opcode & 0xFF;
+
+    // Decode
+    std::uint8_t    X = nibble_2(byte_one);
+    std::uint8_t    Y = nibble_1(byte_two);
+    std::uint8_t    N = nibble_2(byte_two);
+    std::uint8_t   NN = byte_two;
+    std::uint16_t NNN = (X << 8) + byte_two;
+
+    switch (nibble_1(byte_one)) {
+        case 0x00: {
+            if (byte_two == 0xE0) {
+                // turn all pixels to 0
+                clear_screen();
+            } else if (byte_two == 0xEE) {
+                stack_pointer = (stack_pointer - 1) & 0xF;
+                PC = stack[stack_pointer];
+            }
+            break;
+        } case 0x01: {
+            // PC already points past the jump, so this catches loops of up to 8 instructions
+            if (NNN < PC && PC - NNN <= 16) loop_candidate = true;
+            PC = NNN;
+            break;
+        } case 0x02: {
+            stack[stack_pointer] = PC;
+            stack_pointer = (stack_pointer + 1) & 0xF;
+            PC = NNN;
+            break;
+        } case 0x03: {
+            if (gpv_registers[X] == byte_two) PC += 2;
+            break;
+        } case 0x04: {
+            if (gpv_registers[X] != byte_two) PC += 2;
+            break;
+        } case 0x05: {
+            if (gpv_registers[X] == gpv_registers[Y]) PC += 2;
+            break;
+        } case 0x06: {
+            gpv_registers[X] = byte_two;
+            break;
+        } case 0x07: {
+            gpv_registers[X] += byte_two;
+            break;
+        } case 0x08: {
+            arithmetic(X, Y, N);
+            break;
+        } case 0x09: {
+            if (gpv_registers[X] != gpv_registers[Y]) PC += 2;
+            break;
+        } case 0x0A: {
+            index_register = NNN;
+            break;
+        } case 0x0B: {
+            if (!chip48_mode) {
+                NNN = NNN + gpv_registers[0x0];
+                PC = NNN;
+            } else {
+                std::uint16_t XNN = NN + gpv_registers[X];
+                PC = XNN;
+            }
+            break;
+        } case 0x0C: {
+            gpv_registers[X] = random_byte() & byte_two;
+            break;
+        } case 0x0D: {
+            draw_sprite(X, Y, N);
+            break;
+        } case 0x0E: {
+            stats.input_polls++;
+            switch (byte_two) {
+                case 0x9E: {
+                    if (keys[gpv_registers[X] & 0xF]) PC += 2;
+                    break;
+                } case 0xA1: {
+                    if (!keys[gpv_registers[X] & 0xF]) PC += 2;
+                    break;
+                }
+            }
+            break;
+        } case 0x0F: {
+            switch (byte_two) {
+                case 0x02: {
+                    load_audio_pattern();
+                    break;
+                } case 0x07: {
+                    gpv_registers[X] = delay_timer;
+                    break;
+                } case 0x15: {
+                    delay_timer = gpv_registers[X];
+                    break;
+                } case 0x18: {
+                    sound_timer = gpv_registers[X];
+                    break;
+                } case 0x3A: {
+                    audio_pitch = gpv_registers[X];
+                    break;
+                } case 0x1E: {
+                    index_register += gpv_registers[X];
+                    break;
+                } case 0x0A: {
+                    // block by re-executing this opcode until a key is held
+                    stats.input_polls++;
+                    bool pressed = false;
+                    for (int key = 0; key < 16; key++) {
+                        if (keys[key]) {
+                            gpv_registers[X] = key;
+                            pressed = true;
+                            break;
+                        }
+                    }
+                    if (!pressed) {
+                        PC -= 2;
+                        loop_candidate = true;
+                    }
+                    break;
+                } case 0x29: {
+                    index_register = 0x050 + gpv_registers[X] * 5;
+                    break;
+                } case 0x33: {
+                    store_bcd(X);
+                    break;
+                } case 0x55: {
+                    store_registers(X);
+                    break;
+                } case 0x65: {
+                    load_registers(X);
+                    break;
+                }
+            }
+            break;
+        }
+    }
+}
+
+constexpr void Chip8::tick_timers() {
+    if (delay_timer > 0 || sound_timer > 0) stats.timer_ticks++;
+    if (delay_timer > 0) {
+        delay_timer -= 1;
+    }
+    if (sound_timer > 0) {
+        sound_timer -= 1;
+    }
+}
+
+constexpr void Chip8::run_frame(int instructions) {
+    NoHooks hooks;
+    run_frame(instructions, hooks);
+}
+
+template <typename Hooks>
+constexpr int Chip8::run_frame(int instructions, Hooks &hooks) {
+    // neither runs hooks, the frontends don't attach any to them
+    if (megachip != nullptr) {
+        megachip->run_frame(*this, instructions);
+        stats.frames++;
+        return instructions;
+    }
+    if (vip_timing) {
+        run_vip_frame();
+        stats.frames++;
+        return instructions;
+    }
+
+    // where the last loop candidate jumped to and when, a loop is only skipped
+    // once it has been seen to go all the way round from its head
+    std::uint16_t loop_head = 0xFFFF;
+    int loop_start = 0;
+
+    int i = 0;
+    while (i < instructions) {
+        if constexpr (Hooks::active) {
+            if (hooks.before_step(*this)) {
+                cycle_count += i;
+                return i;
+            }
+        } else {
+            if (native_code != nullptr) {
+                int executed = native_code(*this, instructions - i);
+                if (executed > 0) {
+                    i += executed;
+                    // native code hands back after a short backward jump so the loop is seen here
+                    if (loop_candidate && ends_on_idle_loop(loop_head, loop_start, i, instructions)) break;
+                    continue;
+                }
+            }
+
+            if (block_cache != nullptr) {
+                int executed = block_cache->run(*this, instructions - i);
+                if (executed > 0) {
+                    i += executed;
+                    continue;
+                }
+            }
+
+            if (fuse) {
+                // the longest superinstruction covers 3 instructions, shorter ones that
+                // don't fit are left to step() near the end of the frame
+                Fused kind = fusion[PC & 0xFFF];
+                if (kind != Fused::None && instructions - i >= 3) {
+                    int covered = step_fused(kind);
+                    i += covered;
+                    fused_count++;
+                    fused_cycles += covered;
+                    continue;
+                }
+            }
+        }
+
+        step();
+        i++;
+        if constexpr (Hooks::active) {
+            if (hooks.after_step(*this) && i < instructions) {
+                cycle_count += i;
+                return i;
+            }
+        }
+        if (loop_candidate && ends_on_idle_loop(loop_head, loop_start, i, instructions)) break;
+    }
+    cycle_count += i;
+    tick_timers();
+    stats.frames++;
+    return instructions;
+}
+
+constexpr bool Chip8::ends_on_idle_loop(std::uint16_t &loop_head, int &loop_start, int i, int instructions) {
+    loop_candidate = false;
+    if (skip_idle_loops && PC == loop_head && i - loop_start <= 8 && is_idle_loop(PC)) {
+        elided_cycles += instructions - i;
+        stats.idle_frames++;
+        return true;
+    }
+    loop_head = PC;
+    loop_start = i;
+    return false;
+}
+
+constexpr void Chip8::run_vip_frame() {
+    std::uint16_t loop_head = 0xFFFF;
+    int loop_start = 0;
+    int loop_start_cycles = 0;
+
+    int budget = vip_frame_cycles - vip_display_cycles;
+    int cycles = vip_cycle_debt;
+    vip_cycle_debt = 0;
+    int i = 0;
+    while (cycles < budget) {
+        std::uint16_t pc = PC & 0xFFF;
+        std::uint8_t high = memory[pc] >> 4;
+        int cost = vip_cost[pc];
+        step();
+        i++;
+
+        if (high == 0xD) {
+            // the VIP draws once the display interrupt has fired, so the
+            // sprite's own cost lands at the start of the next frame
+            vip_cycle_debt = cost;
+            break;
+        }
+        cycles += cost;
+        // 3XNN, 4XNN, 5XY0, 9XY0 and EXNN
+        if (PC - pc == 4 && (0x4238 >> high) & 1) cycles += vip_skip_cycles;
+        if (loop_candidate) {
+            loop_candidate = false;
+            if (skip_idle_loops && PC == loop_head && i - loop_start <= 8 && is_idle_loop(PC)) {
+                // the instructions going round the loop for the rest of the budget would have run
+                int pass = cycles - loop_start_cycles;
+                if (pass > 0) elided_cycles += ((budget - cycles) * (i - loop_start) + pass - 1) / pass;
+                stats.idle_frames++;
+                break;
+            }
+            loop_head = PC;
+            loop_start = i;
+            loop_start_cycles = cycles;
+        }
+    }
+    if (cycles > budget) vip_cycle_debt = cycles - budget;
+    cycle_count += i;
+    tick_timers();
+}
+
+// Whether every pass through the loop starting at `head` takes the same path
+// until the next frame, so a loop that has come back to `head` once will keep
+// doing so. The loop must be made of reads of the delay timer and keypad,
+// constant loads and skips, where every skip guards a jump and no skip reads
+// a register that is written further down the loop. Every jump must go back
+// to `head`: the instructions are read straight down, so a jump elsewhere
+// could lead through code this never looks at.
+constexpr bool Chip8::is_idle_loop(std::uint16_t head) const {
+    std::uint16_t opcodes[8];
+    int count = 0;
+    for (std::uint16_t address = head; count < 8; address = (address + 2) & 0xFFF) {
+        std::uint16_t opcode = (memory[address] << 8) | memory[(address + 1) & 0xFFF];
+        // FX0A waiting on the keypad is a loop on its own
+        if (count == 0 && (opcode & 0xF0FF) == 0xF00A) return true;
+        opcodes[count++] = opcode;
+        if ((opcode & 0xF000) == 0x1000 && (opcode & 0x0FFF) == head) break;
+    }
+    if ((opcodes[count - 1] & 0xF000) != 0x1000 || (opcodes[count - 1] & 0x0FFF) != head) return false;
+
+    // registers written by the instructions after each position
+    std::uint16_t written_later = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        std::uint16_t opcode = opcodes[i];
+        std::uint8_t x = (opcode >> 8) & 0xF;
+        std::uint8_t y = (opcode >> 4) & 0xF;
+        bool guards_jump = i + 1 < count && (opcodes[i + 1] & 0xF000) == 0x1000;
+
+        switch (opcode >> 12) {
+            case 0x1:
+                if ((opcode & 0x0FFF) != head) return false;
+                break;
+            case 0x3: case 0x4:
+                if (!guards_jump || (written_later >> x) & 1) return false;
+                break;
+            case 0x5: case 0x9:
+                if ((opcode & 0xF) != 0 || !guards_jump || ((written_later >> x) & 1) || ((written_later >> y) & 1)) return false;
+                break;
+            case 0xE:
+                if (((opcode & 0xFF) != 0x9E && (opcode & 0xFF) != 0xA1) || !guards_jump || (written_later >> x) & 1) return false;
+                break;
+            case 0x6:
+                written_later |= 1 << x;
+                break;
+            case 0xF:
+                if ((opcode & 0xFF) != 0x07) return false;
+                written_later |= 1 << x;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+#endif //CHIP8_EMULATOR_CHIP8_H
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include "debugger.h"
+
+namespace {
+
+// a hex number with an optional 0x, no trailing junk
+bool parse_hex(const std::string &text, unsigned long &value) {
+    if (text.empty()) return false;
+    char *end = nullptr;
+    value = std::strtoul(text.c_str(), &end, 16);
+    return *end == '\0';
+}
+
+bool parse_address(const std::string &text, std::uint16_t &address) {
+    unsigned long value;
+    if (!parse_hex(text, value) || value > 0xFFF) return false;
+    address = value;
+    return true;
+}
+
+bool parse_condition(std::istringstream &in, Debugger::Condition &condition) {
+    using Condition = Debugger::Condition;
+    std::string operand, compare, value;
+    if (!(in >> operand >> compare >> value)) return false;
+
+    for (char &c : operand) c = std::toupper(static_cast<unsigned char>(c));
+    unsigned long reg;
+    if (operand == "I") {
+        condition.operand = Condition::Operand::I;
+    } else if (operand == "DT") {
+        condition.operand = Condition::Operand::DT;
+    } else if (operand == "ST") {
+        condition.operand = Condition::Operand::ST;
+    } else if (operand.size() == 2 && operand[0] == 'V' && parse_hex(operand.substr(1), reg)) {
+        condition.operand = Condition::Operand::V;
+        condition.reg = reg;
+    } else {
+        return false;
+    }
+
+    static const char *const compares[] = {"==", "!=", "<", "<=", ">", ">="};
+    auto found = std::find(std::begin(compares), std::end(compares), compare);
+    if (found == std::end(compares)) return false;
+    condition.compare = static_cast<Condition::Compare>(found - std::begin(compares));
+
+    unsigned long number;
+    if (!parse_hex(value, number) || number > 0xFFFF) return false;
+    condition.value = number;
+    return true;
+}
+
+std::string format(const char *format, unsigned a, unsigned b = 0) {
+    char text[64];
+    snprintf(text, sizeof(text), format, a, b);
+    return text;
+}
+
+}
+
+bool Debugger::Condition::holds(const Chip8 &chip8) const {
+    std::uint16_t current = 0;
+    switch (operand) {
+        case Operand::V: current = chip8.gpv_registers[reg & 0xF]; break;
+        case Operand::I: current = chip8.index_register; break;
+        case Operand::DT: current = chip8.delay_timer; break;
+        case Operand::ST: current = chip8.sound_timer; break;
+    }
+    switch (compare) {
+        case Compare::Equal: return current == value;
+        case Compare::NotEqual: return current != value;
+        case Compare::Less: return current < value;
+        case Compare::LessEqual: return current <= value;
+        case Compare::Greater: return current > value;
+        case Compare::GreaterEqual: return current >= value;
+    }
+    return false;
+}
+
+void Debugger::add_breakpoint(std::uint16_t address) {
+    breakpoints_.set(address & 0xFFF);
+    conditions_.erase(address & 0xFFF);
+}
+
+void Debugger::add_breakpoint(std::uint16_t address, const Condition &condition) {
+    breakpoints_.set(address & 0xFFF);
+    conditions_[address & 0xFFF] = condition;
+}
+
+void Debugger::remove_breakpoint(std::uint16_t address) {
+    breakpoints_.reset(address & 0xFFF);
+    conditions_.erase(address & 0xFFF);
+}
+
+void Debugger::watch(Chip8 &chip8, std::uint16_t address, int length, bool read, bool write) {
+    for (int i = 0; i < std::min(length, 4096); i++) {
+        std::uint16_t watched = (address + i) & 0xFFF;
+        bool reads = chip8.watch_reads[watched / 64] >> (watched % 64) & 1;
+        bool writes = chip8.watch_writes[watched / 64] >> (watched % 64) & 1;
+        // w and rw add to what is already watched, uw clears both
+        if (read || write) chip8.set_watch(watched, reads || read, writes || write);
+        else chip8.set_watch(watched, false, false);
+    }
+}
+
+void Debugger::run_to_frame(std::uint64_t frame) {
+    stop_frame_ = frame;
+}
+
+void Debugger::resume(const Chip8 &chip8, int steps) {
+    paused_ = false;
+    steps_ = steps > 0 ? steps : -1;
+    resumed_at_ = chip8.PC & 0xFFF;
+    watch_hits_ = chip8.watch_hits;
+}
+
+bool Debugger::condition_holds(std::uint16_t pc, const Chip8 &chip8) const {
+    auto condition = conditions_.find(pc);
+    return condition == conditions_.end() || condition->second.holds(chip8);
+}
+
+std::string Debugger::watch_reason(const Chip8 &chip8) const {
+    return format(chip8.watch_write ? "write to %03X by %03X" : "read of %03X by %03X",
+                  chip8.watch_address, last_pc_);
+}
+
+void Debugger::run_frame(Chip8 &chip8, int instructions) {
+    if (paused_) return;
+
+    frame_progress_ += chip8.run_frame(instructions - frame_progress_, *this);
+    if (frame_progress_ < instructions) return;
+
+    frame_progress_ = 0;
+    frames_++;
+    if (stop_frame_ != 0 && frames_ >= stop_frame_) {
+        stop_frame_ = 0;
+        pause(Stop::Frame, "frame");
+    }
+}
+
+std::string Debugger::registers(const Chip8 &chip8) const {
+    std::string out = format("PC %03X  I %03X", chip8.PC, chip8.index_register);
+    out += format("  DT %02X  ST %02X", chip8.delay_timer, chip8.sound_timer);
+    out += format("  SP %X  opcode %04X\n", chip8.stack_pointer,
+                  chip8.memory[chip8.PC & 0xFFF] << 8 | chip8.memory[(chip8.PC + 1) & 0xFFF]);
+    for (int reg = 0; reg < 16; reg++) {
+        out += format(reg == 15 ? "V%X %02X\n" : "V%X %02X  ", reg, chip8.gpv_registers[reg]);
+    }
+    return out;
+}
+
+std::string Debugger::command(Chip8 &chip8, const std::string &line) {
+    std::istringstream in(line);
+    std::string name, argument;
+    if (!(in >> name)) return "";
+    in >> argument;
+
+    std::uint16_t address = 0;
+    if (name == "b" || name == "d" || name == "w" || name == "rw" || name == "uw") {
+        if (!parse_address(argument, address)) return "expected an address below 0x1000\n";
+    }
+
+    if (name == "b") {
+        Condition condition;
+        in >> std::ws;
+        if (in.eof()) {
+            add_breakpoint(address);
+        } else if (parse_condition(in, condition)) {
+            add_breakpoint(address, condition);
+        } else {
+            return "expected a condition like V3 == 5\n";
+        }
+    } else if (name == "d") {
+        remove_breakpoint(address);
+    } else if (name == "w" || name == "rw" || name == "uw") {
+        unsigned long length = 1;
+        std::string count;
+        if (in >> count && !parse_hex(count, length)) return "expected an optional length\n";
+        watch(chip8, address, length, name == "rw", name == "w");
+    } else if (name == "c") {
+        resume(chip8);
+    } else if (name == "s") {
+        resume(chip8, std::max(1, std::atoi(argument.c_str())));
+    } else if (name == "f") {
+        long long frame = std::atoll(argument.c_str());
+        if (frame <= static_cast<long long>(frames_)) return "frame already reached\n";
+        run_to_frame(frame);
+        resume(chip8);
+    } else if (name == "r") {
+        return registers(chip8);
+    } else if (name == "m") {
+        unsigned long length = 16;
+        std::string count;
+        if (!parse_address(argument, address) || (in >> count && !parse_hex(count, length))) {
+            return "expected an address and an optional length\n";
+        }
+        std::string out;
+        for (unsigned long i = 0; i < std::min(length, 4096ul); i++) {
+            if (i % 16 == 0) out += format(i == 0 ? "%03X:" : "\n%03X:", (address + i) & 0xFFF);
+            out += format(" %02X", chip8.memory[(address + i) & 0xFFF]);
+        }
+        return out + "\n";
+    } else if (name == "l") {
+        std::string out;
+        for (int pc = 0; pc < 4096; pc++) {
+            if (breakpoints_[pc]) out += format(conditions_.count(pc) ? "break %03X if\n" : "break %03X\n", pc);
+        }
+        for (int address = 0; address < 4096; address++) {
+            bool reads = chip8.watch_reads[address / 64] >> (address % 64) & 1;
+            bool writes = chip8.watch_writes[address / 64] >> (address % 64) & 1;
+            if (reads || writes) {
+                out += format(reads && writes ? "watch %03X reads and writes\n"
+                                              : reads ? "watch %03X reads\n" : "watch %03X writes\n", address);
+            }
+        }
+        return out;
+    } else {
+        return "unknown command " + name + "\n";
+    }
+    return "";
+}
@@ -0,0 +1,125 @@
+#ifndef CHIP8_EMULATOR_DEBUGGER_H
+#define CHIP8_EMULATOR_DEBUGGER_H
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "chip8.h"
+
+// Interactive debugger driving Chip8::run_frame() through its hooks, so the
+// normal loop is compiled without them and a session runs at full speed
+// between stops: an instruction only pays a bit test for PC breakpoints and a
+// compare of Chip8::watch_hits, the watchpoint bitmaps live in the core.
+//
+// Commands, addresses and values in hex with an optional 0x:
+//   b ADDR [REG OP VALUE]   break at ADDR, optionally only when e.g. V3 == 5
+//                           (REG is V0-VF, I, DT or ST, OP one of == != < <= > >=)
+//   d ADDR                  delete the breakpoint at ADDR
+//   w ADDR [LEN]            stop after an instruction writes memory[ADDR, ADDR + LEN)
+//   rw ADDR [LEN]           stop after an instruction reads it
+//   uw ADDR [LEN]           stop watching it
+//   c                       continue
+//   s [N]                   run N instructions, 1 by default (decimal)
+//   f FRAME                 run until FRAME frames have completed (decimal)
+//   r                       registers
+//   m ADDR [LEN]            dump LEN bytes of memory, 16 by default
+//   l                       list breakpoints and watchpoints
+class Debugger {
+public:
+    static constexpr bool active = true;
+
+    // what the last stop was for
+    enum class Stop : std::uint8_t { Start, Step, Breakpoint, Watch, Frame, Interrupt };
+
+    // register compared by a conditional breakpoint
+    struct Condition {
+        enum class Operand : std::uint8_t { V, I, DT, ST };
+        enum class Compare : std::uint8_t { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+        Operand operand = Operand::V;
+        std::uint8_t reg = 0;
+        Compare compare = Compare::Equal;
+        std::uint16_t value = 0;
+
+        bool holds(const Chip8 &chip8) const;
+    };
+
+    void add_breakpoint(std::uint16_t address);
+    void add_breakpoint(std::uint16_t address, const Condition &condition);
+    void remove_breakpoint(std::uint16_t address);
+    // watches for writes, reads or both of memory[address, address + length)
+    void watch(Chip8 &chip8, std::uint16_t address, int length, bool read, bool write);
+
+    // stops once `frame` frames have run in this session
+    void run_to_frame(std::uint64_t frame);
+
+    // resumes, for `steps` instructions when positive
+    void resume(const Chip8 &chip8, int steps = 0);
+    void pause(Stop stop, const std::string &reason) {
+        paused_ = true;
+        stop_ = stop;
+        reason_ = reason;
+    }
+    bool paused() const { return paused_; }
+    Stop stop_kind() const { return stop_; }
+    // why the last stop happened
+    const std::string &reason() const { return reason_; }
+
+    // one frame's worth of instructions, picking up where the last stop left
+    // the frame. Does nothing while paused.
+    void run_frame(Chip8 &chip8, int instructions);
+    std::uint64_t frames() const { return frames_; }
+
+    // runs one command line, returns what to print
+    std::string command(Chip8 &chip8, const std::string &line);
+    std::string registers(const Chip8 &chip8) const;
+
+    // run_frame() hooks
+    bool before_step(const Chip8 &chip8) {
+        std::uint16_t pc = chip8.PC & 0xFFF;
+        if (steps_ == 0) return stop(Stop::Step, "step");
+        if (breakpoints_[pc] && pc != resumed_at_ && condition_holds(pc, chip8)) {
+            return stop(Stop::Breakpoint, "breakpoint");
+        }
+        resumed_at_ = -1;
+        last_pc_ = pc;
+        if (steps_ > 0) steps_--;
+        return false;
+    }
+
+    bool after_step(const Chip8 &chip8) {
+        if (chip8.watch_hits == watch_hits_) return false;
+        watch_hits_ = chip8.watch_hits;
+        return stop(Stop::Watch, watch_reason(chip8));
+    }
+
+private:
+    bool stop(Stop stop, const std::string &reason) {
+        pause(stop, reason);
+        return true;
+    }
+
+    bool condition_holds(std::uint16_t pc, const Chip8 &chip8) const;
+    std::string watch_reason(const Chip8 &chip8) const;
+
+    std::bitset<4096> breakpoints_;
+    std::unordered_map<std::uint16_t, Condition> conditions_;
+
+    std::uint64_t watch_hits_ = 0;
+    // address of the instruction running, for reporting watchpoint hits
+    std::uint16_t last_pc_ = 0;
+
+    bool paused_ = true;
+    Stop stop_ = Stop::Start;
+    std::string reason_ = "start";
+    // instructions left to single step, negative when running freely
+    int steps_ = -1;
+    // a breakpoint at the address execution resumed from is not hit again straight away
+    int resumed_at_ = -1;
+
+    std::uint64_t frames_ = 0;
+    std::uint64_t stop_frame_ = 0;
+    // instructions already run in the current frame
+    int frame_progress_ = 0;
+};
+#endif //CHIP8_EMULATOR_DEBUGGER_H
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "block_cache.h"
+#include "chip8.h"
+#include "halt_detector.h"
+#include "rom_pack.h"
+
+// chip8-diverge: runs one rom under two configurations side by side and
+// reports the first instruction where their states part ways, e.g. to check
+// a dispatch tier or a quirk change against the plain interpreter.
+//
+// Both machines run whole frames with every tier they are configured for and
+// only compare state hashes every --block frames. The first mismatch is then
+// bisected from the last matching checkpoint, first by frames and then by
+// instructions into the frame, replaying both machines from snapshots.
+//
+// Skipping an idle loop ends the frame with PC at the loop's head, where a
+// machine that runs the loop out stops anywhere inside it. The other machine
+// is then stepped round to the head, so both leave the loop in step.
+
+namespace {
+
+struct Config {
+    bool fuse = false;
+    bool tiered = false;
+    bool skip_idle_loops = true;
+    bool chip48_mode = true;
+    bool vip_timing = false;
+};
+
+// comma separated: fuse, tiered, no-idle-skip, chip48 (VIP shift and jump quirks), vip-timing
+bool parse_config(const std::string &text, Config &config) {
+    std::istringstream names(text);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        if (name == "fuse") config.fuse = true;
+        else if (name == "tiered") config.tiered = true;
+        else if (name == "no-idle-skip") config.skip_idle_loops = false;
+        else if (name == "chip48") config.chip48_mode = false;
+        else if (name == "vip-timing") config.vip_timing = true;
+        else if (!name.empty() && name != "plain") return false;
+    }
+    return true;
+}
+
+struct Machine {
+    Config config;
+    Chip8 chip8;
+    BlockCache block_cache;
+    StateHasher hasher;
+    // whether the last frame was cut short on an idle loop
+    bool idle_ended = false;
+
+    void restore(const Chip8 &snapshot) {
+        chip8 = snapshot;
+        chip8.chip48_mode = config.chip48_mode;
+        chip8.skip_idle_loops = config.skip_idle_loops;
+        chip8.fuse = config.fuse;
+        chip8.vip_timing = config.vip_timing;
+        block_cache.clear();
+        chip8.block_cache = config.tiered ? &block_cache : nullptr;
+        hasher.reset();
+        idle_ended = false;
+    }
+
+    std::uint64_t hash() { return hasher.hash(chip8); }
+
+    void run_frame(int instructions) {
+        std::uint64_t elided = chip8.elided_cycles;
+        chip8.run_frame(instructions);
+        idle_ended = chip8.elided_cycles != elided;
+    }
+};
+
+// Steps `other` on to the head of the idle loop `idle` skipped the rest of
+// the frame from. The loop is idle, so those steps only move PC; they stop
+// once PC leaves the at most 8 instructions an idle loop spans.
+void align_idle(const Machine &idle, Machine &other) {
+    if (!idle.idle_ended || other.idle_ended) return;
+    int head = idle.chip8.PC & 0xFFF;
+    for (int i = 0; i < 8; i++) {
+        int pc = other.chip8.PC & 0xFFF;
+        if (pc <= head || pc >= head + 16) return;
+        other.chip8.step();
+    }
+}
+
+// a frame, or `instructions` of one, on both machines
+void run_frame(Machine &a, Machine &b, int instructions) {
+    a.run_frame(instructions);
+    b.run_frame(instructions);
+    align_idle(a, b);
+    align_idle(b, a);
+}
+
+void show_diverge_usage(const std::string &name) {
+    std::cerr << "Usage: " << name << " <rom> --a <config> --b <config> <option(s)>\n"
+              << "A config is a comma separated list of fuse, tiered, no-idle-skip, chip48 and vip-timing,\n"
+              << "or plain for the interpreter on its own.\n"
+              << "Options:\n"
+              << "\t--frames <n>\t\tFrames to run before giving up (default 36000)\n"
+              << "\t--ipf <n>\t\tInstructions per frame (default 12)\n"
+              << "\t--block <n>\t\tFrames between state hash comparisons (default 64)\n"
+              << "\t--rom <name>\t\tThe pack entry to run (default the first)"
+              << std::endl;
+}
+
+// replays both machines `frames` frames from the snapshots, then `instructions`
+// more as a shortened frame, and returns whether they still agree
+bool agree_after(Machine &a, Machine &b, const Chip8 &snapshot_a, const Chip8 &snapshot_b,
+                 long long frames, int instructions, int ipf) {
+    a.restore(snapshot_a);
+    b.restore(snapshot_b);
+    for (long long frame = 0; frame < frames; frame++) run_frame(a, b, ipf);
+    if (instructions > 0) run_frame(a, b, instructions);
+    return a.hash() == b.hash();
+}
+
+void print_diff(const Chip8 &a, const Chip8 &b) {
+    char line[96];
+    auto field = [&](const char *name, unsigned x, unsigned y, const char *format) {
+        if (x == y) return;
+        std::string text = std::string("  %-6s ") + format + "  " + format + "\n";
+        snprintf(line, sizeof(line), text.c_str(), name, x, y);
+        std::cout << line;
+    };
+    std::cout << "           a     b\n";
+    field("PC", a.PC, b.PC, "%03X");
+    field("I", a.index_register, b.index_register, "%03X");
+    field("SP", a.stack_pointer, b.stack_pointer, "%X");
+    field("DT", a.delay_timer, b.delay_timer, "%02X");
+    field("ST", a.sound_timer, b.sound_timer, "%02X");
+    for (int n = 0; n < 16; n++) {
+        const char name[] = {'V', "0123456789ABCDEF"[n], '\0'};
+        field(name, a.gpv_registers[n], b.gpv_registers[n], "%02X");
+    }
+    for (int n = 0; n < 16; n++) {
+        std::string name = "stack" + std::to_string(n);
+        field(name.c_str(), a.stack[n], b.stack[n], "%03X");
+    }
+    field("random", a.random_state, b.random_state, "%08X");
+    field("debt", a.vip_cycle_debt, b.vip_cycle_debt, "%d");
+
+    int shown = 0, differing = 0;
+    for (int address = 0; address < 4096; address++) {
+        if (a.memory[address] == b.memory[address]) continue;
+        if (shown++ < 32) {
+            snprintf(line, sizeof(line), "  %03X    %02X    %02X\n", address, a.memory[address], b.memory[address]);
+            std::cout << line;
+        }
+        differing++;
+    }
+    if (differing > shown) std::cout << "  ... " << differing << " bytes of memory differ\n";
+
+    int pixels = 0;
+    for (int x = 0; x < 64; x++) {
+        for (int y = 0; y < 32; y++) pixels += a.screen[x][y] != b.screen[x][y];
+    }
+    if (pixels > 0) std::cout << "  " << pixels << " pixels differ\n";
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help") {
+        show_diverge_usage(argv[0]);
+        return argc < 2 ? 1 : 0;
+    }
+
+    Machine a, b;
+    long long max_frames = 36000;
+    int ipf = 12;
+    long long block = 64;
+    std::string rom_name;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "--a" || arg == "--b") && i + 1 < argc) {
+            if (!parse_config(argv[++i], arg == "--a" ? a.config : b.config)) {
+                std::cerr << "unknown configuration " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--frames" && i + 1 < argc) {
+            max_frames = std::max(1ll, std::atoll(argv[++i]));
+        } else if (arg == "--ipf" && i + 1 < argc) {
+            ipf = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--block" && i + 1 < argc) {
+            block = std::max(1ll, std::atoll(argv[++i]));
+        } else if (arg == "--rom" && i + 1 < argc) {
+            rom_name = argv[++i];
+        }
+    }
+
+    RomPack pack;
+    if (!pack.open(argv[1])) {
+        std::cerr << pack.error() << std::endl;
+        return 1;
+    }
+    const RomEntry *entry = rom_name.empty() ? (pack.entries().empty() ? nullptr : &pack.entries().front())
+                                             : pack.find(rom_name);
+    if (entry == nullptr) {
+        std::cerr << "no rom " << (rom_name.empty() ? "" : rom_name + " ") << "in " << argv[1] << std::endl;
+        return 1;
+    }
+    const RomEntry &rom = *entry;
+
+    Chip8 initial;
+    initial.reset();
+    if (!initial.load_rom(rom.data.data(), rom.data.size())) {
+        std::cerr << rom.name << " is too large to fit in memory" << std::endl;
+        return 1;
+    }
+
+    // the state of each machine at the last frame where both agreed
+    Chip8 snapshot_a = initial, snapshot_b = initial;
+    a.restore(initial);
+    b.restore(initial);
+    long long agreed = 0;
+    long long frame = 0;
+    while (frame < max_frames) {
+        run_frame(a, b, ipf);
+        frame++;
+        if (frame % block != 0 && frame != max_frames) continue;
+
+        if (a.hash() == b.hash()) {
+            snapshot_a = a.chip8;
+            snapshot_b = b.chip8;
+            agreed = frame;
+            continue;
+        }
+
+        // bisect the frames since the checkpoint, moving it forward as halves agree
+        long long differs = frame;
+        while (differs - agreed > 1) {
+            long long middle = agreed + (differs - agreed) / 2;
+            if (agree_after(a, b, snapshot_a, snapshot_b, middle - agreed, 0, ipf)) {
+                snapshot_a = a.chip8;
+                snapshot_b = b.chip8;
+                agreed = middle;
+            } else {
+                differs = middle;
+            }
+        }
+
+        // then the instructions into the first frame that differs; VIP timing
+        // sizes its own frames, so there the frame is as close as it gets
+        int instruction = 0;
+        bool by_instruction = !a.config.vip_timing && !b.config.vip_timing;
+        if (by_instruction) {
+            int same = 0, different = ipf;
+            while (different - same > 1) {
+                int middle = (same + different) / 2;
+                if (agree_after(a, b, snapshot_a, snapshot_b, 0, middle, ipf)) same = middle;
+                else different = middle;
+            }
+            instruction = different;
+            // the state just before the instruction, to show what it was
+            agree_after(a, b, snapshot_a, snapshot_b, 0, instruction - 1, ipf);
+        }
+
+        const Chip8 &before = by_instruction ? a.chip8 : snapshot_a;
+        std::uint16_t pc = before.PC & 0xFFF;
+        std::uint16_t opcode = before.memory[pc] << 8 | before.memory[(pc + 1) & 0xFFF];
+        // the longest is every field at its widest, 118 characters
+        char where[128];
+        if (by_instruction) {
+            snprintf(where, sizeof(where), "instruction %d of frame %lld (about cycle %lld), PC %03X opcode %04X",
+                     instruction, differs, (differs - 1) * ipf + instruction, pc, opcode);
+        } else {
+            snprintf(where, sizeof(where), "frame %lld", differs);
+        }
+        std::cout << rom.name << ": first divergence at " << where << "\n";
+
+        if (by_instruction) agree_after(a, b, snapshot_a, snapshot_b, 0, instruction, ipf);
+        else agree_after(a, b, snapshot_a, snapshot_b, 1, 0, ipf);
+        print_diff(a.chip8, b.chip8);
+        return 1;
+    }
+
+    std::cout << rom.name << ": no divergence in " << max_frames << " frames\n";
+    return 0;
+}
@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "gdb_stub.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+const int send_flags = MSG_NOSIGNAL;
+#else
+const int send_flags = 0;
+#endif
+
+void close_socket(std::intptr_t socket) {
+#ifdef _WIN32
+    closesocket((SOCKET)socket);
+#else
+    ::close((int)socket);
+#endif
+}
+
+bool set_nonblocking(std::intptr_t socket) {
+#ifdef _WIN32
+    u_long on = 1;
+    return ioctlsocket((SOCKET)socket, FIONBIO, &on) == 0;
+#else
+    int flags = fcntl((int)socket, F_GETFL, 0);
+    return flags >= 0 && fcntl((int)socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+const char hex_digits[] = "0123456789abcdef";
+
+void append_hex(std::string &out, std::uint8_t byte) {
+    out += hex_digits[byte >> 4];
+    out += hex_digits[byte & 0xF];
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// the hex bytes of `text` from `from`, false on anything else
+bool parse_bytes(const std::string &text, std::size_t from, std::string &bytes) {
+    if ((text.size() - from) % 2 != 0) return false;
+    for (std::size_t i = from; i < text.size(); i += 2) {
+        int high = hex_value(text[i]), low = hex_value(text[i + 1]);
+        if (high < 0 || low < 0) return false;
+        bytes += (char)(high << 4 | low);
+    }
+    return true;
+}
+
+// "ADDR,LEN" as used by m, M and Z, `end` is left after LEN
+bool parse_range(const std::string &text, std::size_t from, unsigned long &address, unsigned long &length,
+                 std::size_t *end = nullptr) {
+    char *next = nullptr;
+    address = std::strtoul(text.c_str() + from, &next, 16);
+    if (*next != ',') return false;
+    length = std::strtoul(next + 1, &next, 16);
+    if (end != nullptr) *end = next - text.c_str();
+    return address < 0x1000;
+}
+
+const int register_count = 19;
+
+// register n in target byte order
+std::string read_register(const Chip8 &chip8, int n) {
+    std::string out;
+    if (n < 16) {
+        append_hex(out, chip8.gpv_registers[n]);
+    } else if (n == 18) {
+        append_hex(out, chip8.stack_pointer);
+    } else {
+        std::uint16_t value = n == 16 ? chip8.index_register : chip8.PC;
+        append_hex(out, value & 0xFF);
+        append_hex(out, value >> 8);
+    }
+    return out;
+}
+
+// sets register n from its bytes, returns how many it used
+std::size_t write_register(Chip8 &chip8, int n, const std::string &bytes, std::size_t at) {
+    auto byte = [&](std::size_t i) -> std::uint8_t { return i < bytes.size() ? bytes[i] : 0; };
+    if (n < 16) {
+        chip8.gpv_registers[n] = byte(at);
+        return 1;
+    }
+    if (n == 18) {
+        chip8.stack_pointer = byte(at) & 0xF;
+        return 1;
+    }
+    std::uint16_t value = byte(at) | byte(at + 1) << 8;
+    if (n == 16) chip8.index_register = value;
+    else chip8.PC = value & 0xFFF;
+    return 2;
+}
+
+std::string target_xml() {
+    std::string xml = "<?xml version=\"1.0\"?>\n<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+                      "<target version=\"1.0\">\n<feature name=\"org.chip8.core\">\n";
+    char line[80];
+    for (int n = 0; n < 16; n++) {
+        snprintf(line, sizeof(line), "<reg name=\"v%x\" bitsize=\"8\" type=\"uint8\" regnum=\"%d\"/>\n", n, n);
+        xml += line;
+    }
+    xml += "<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\" regnum=\"16\"/>\n"
+           "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\" regnum=\"17\"/>\n"
+           "<reg name=\"sp\" bitsize=\"8\" type=\"uint8\" regnum=\"18\"/>\n"
+           "</feature>\n</target>\n";
+    return xml;
+}
+
+}
+
+GdbStub::~GdbStub() {
+    close_client();
+    if (listener_ != -1) close_socket(listener_);
+#ifdef _WIN32
+    if (listener_ != -1) WSACleanup();
+#endif
+}
+
+bool GdbStub::listen(int port) {
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        error_ = "could not initialise winsock";
+        return false;
+    }
+#endif
+    std::intptr_t listener = (std::intptr_t)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == -1) {
+        error_ = "could not create a socket";
+        return false;
+    }
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(listener, (const sockaddr *)&address, sizeof(address)) != 0 || ::listen(listener, 1) != 0 ||
+        !set_nonblocking(listener)) {
+        close_socket(listener);
+        error_ = "could not listen on 127.0.0.1:" + std::to_string(port);
+        return false;
+    }
+    listener_ = listener;
+    return true;
+}
+
+void GdbStub::accept_client(Debugger &debugger) {
+    std::intptr_t client = (std::intptr_t)accept(listener_, nullptr, nullptr);
+    if (client == -1) return;
+    set_nonblocking(client);
+    int on = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char *)&on, sizeof(on));
+
+    client_ = client;
+    input_.clear();
+    no_ack_ = false;
+    running_ = false;
+    debugger.pause(Debugger::Stop::Interrupt, "gdb attached");
+}
+
+void GdbStub::close_client() {
+    if (client_ == -1) return;
+    close_socket(client_);
+    client_ = -1;
+}
+
+void GdbStub::poll(Debugger &debugger, Chip8 &chip8) {
+    if (listener_ == -1) return;
+    if (client_ == -1) {
+        accept_client(debugger);
+        if (client_ == -1) return;
+    }
+
+    char buffer[4096];
+    while (true) {
+        int received = recv(client_, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            input_.append(buffer, received);
+            continue;
+        }
+        if (received < 0 && would_block()) break;
+        // the client went away, let the rom carry on without it
+        close_client();
+        if (debugger.paused()) debugger.resume(chip8);
+        return;
+    }
+
+    std::size_t at = 0;
+    while (at < input_.size()) {
+        char c = input_[at];
+        if (c == '\x03') {
+            // ctrl-c from the client
+            if (running_) debugger.pause(Debugger::Stop::Interrupt, "interrupted by gdb");
+            at++;
+            continue;
+        }
+        if (c != '$') {
+            // acks, and anything between packets
+            at++;
+            continue;
+        }
+        std::size_t hash = input_.find('#', at);
+        if (hash == std::string::npos || hash + 2 >= input_.size()) break;
+
+        std::string packet = input_.substr(at + 1, hash - at - 1);
+        unsigned checksum = 0;
+        for (char byte : packet) checksum += (std::uint8_t)byte;
+        int high = hex_value(input_[hash + 1]), low = hex_value(input_[hash + 2]);
+        at = hash + 3;
+        if (!no_ack_ && (high < 0 || low < 0 || (checksum & 0xFF) != (unsigned)(high << 4 | low))) {
+            send_raw("-");
+            continue;
+        }
+        if (!no_ack_) send_raw("+");
+        handle(packet, debugger, chip8);
+        if (client_ == -1) return;
+    }
+    input_.erase(0, at);
+
+    if (running_ && debugger.paused()) {
+        running_ = false;
+        send_packet(stop_reply(debugger, chip8));
+    }
+}
+
+std::string GdbStub::stop_reply(const Debugger &debugger, const Chip8 &chip8) const {
+    if (debugger.stop_kind() == Debugger::Stop::Interrupt) return "T02thread:1;";
+    if (debugger.stop_kind() != Debugger::Stop::Watch) return "T05thread:1;";
+
+    // reads and writes of an address watched both ways report as an access
+    std::uint16_t address = chip8.watch_address;
+    bool reads = chip8.watch_reads[address / 64] >> (address % 64) & 1;
+    bool writes = chip8.watch_writes[address / 64] >> (address % 64) & 1;
+    char reply[48];
+    snprintf(reply, sizeof(reply), "T05%s:%x;thread:1;",
+             reads && writes ? "awatch" : chip8.watch_write ? "watch" : "rwatch", address);
+    return reply;
+}
+
+void GdbStub::handle(const std::string &packet, Debugger &debugger, Chip8 &chip8) {
+    if (packet.empty()) {
+        send_packet("");
+        return;
+    }
+
+    switch (packet[0]) {
+        case '?':
+            send_packet(stop_reply(debugger, chip8));
+            return;
+        case 'g': {
+            std::string out;
+            for (int n = 0; n < register_count; n++) out += read_register(chip8, n);
+            send_packet(out);
+            return;
+        }
+        case 'G': {
+            std::string bytes;
+            if (!parse_bytes(packet, 1, bytes)) break;
+            std::size_t at = 0;
+            for (int n = 0; n < register_count; n++) at += write_register(chip8, n, bytes, at);
+            send_packet("OK");
+            return;
+        }
+        case 'p': {
+            // unsigned, so a negative number wraps round to out of range
+            unsigned long n = std::strtoul(packet.c_str() + 1, nullptr, 16);
+            send_packet(n < (unsigned long)register_count ? read_register(chip8, (int)n) : "E01");
+            return;
+        }
+        case 'P': {
+            char *value = nullptr;
+            unsigned long n = std::strtoul(packet.c_str() + 1, &value, 16);
+            std::string bytes;
+            if (*value != '=' || n >= (unsigned long)register_count || !parse_bytes(packet, value + 1 - packet.c_str(), bytes)) break;
+            write_register(chip8, (int)n, bytes, 0);
+            send_packet("OK");
+            return;
+        }
+        case 'm': {
+            unsigned long address, length;
+            if (!parse_range(packet, 1, address, length)) break;
+            std::string out;
+            for (unsigned long i = 0; i < std::min(length, 0x1000ul - address); i++) {
+                append_hex(out, chip8.memory[address + i]);
+            }
+            send_packet(out);
+            return;
+        }
+        case 'M': {
+            unsigned long address, length;
+            std::size_t colon;
+            std::string bytes;
+            if (!parse_range(packet, 1, address, length, &colon) || packet[colon] != ':' ||
+                !parse_bytes(packet, colon + 1, bytes) || bytes.size() != length || address + length > 0x1000) {
+                break;
+            }
+            for (unsigned long i = 0; i < length; i++) chip8.write_memory(address + i, bytes[i]);
+            send_packet("OK");
+            return;
+        }
+        case 'c':
+            debugger.resume(chip8);
+            running_ = true;
+            return;
+        case 's':
+            debugger.resume(chip8, 1);
+            running_ = true;
+            return;
+        case 'Z':
+        case 'z': {
+            bool set = packet[0] == 'Z';
+            int type = packet.size() > 1 ? packet[1] - '0' : -1;
+            unsigned long address, length;
+            if (packet.size() < 3 || packet[2] != ',' || !parse_range(packet, 3, address, length)) break;
+            if (type == 0 || type == 1) {
+                if (set) debugger.add_breakpoint(address);
+                else debugger.remove_breakpoint(address);
+            } else if (type >= 2 && type <= 4) {
+                // 2 is a write watchpoint, 3 a read one and 4 both
+                bool write = type != 3, read = type != 2;
+                for (unsigned long i = 0; i < std::max(length, 1ul) && address + i < 0x1000; i++) {
+                    std::uint16_t watched = address + i;
+                    bool reads = chip8.watch_reads[watched / 64] >> (watched % 64) & 1;
+                    bool writes = chip8.watch_writes[watched / 64] >> (watched % 64) & 1;
+                    if (set) chip8.set_watch(watched, reads || read, writes || write);
+                    else chip8.set_watch(watched, reads && !read, writes && !write);
+                }
+            } else {
+                send_packet("");
+                return;
+            }
+            send_packet("OK");
+            return;
+        }
+        case 'D':
+            send_packet("OK");
+            close_client();
+            debugger.resume(chip8);
+            return;
+        case 'k':
+            close_client();
+            debugger.resume(chip8);
+            return;
+        case 'H':
+            send_packet("OK");
+            return;
+        case 'T':
+            send_packet("OK");
+            return;
+        case 'q':
+        case 'Q':
+        case 'v':
+            break;
+        default:
+            send_packet("");
+            return;
+    }
+
+    if (packet.rfind("qSupported", 0) == 0) {
+        send_packet("PacketSize=4000;qXfer:features:read+;QStartNoAckMode+");
+    } else if (packet == "QStartNoAckMode") {
+        send_packet("OK");
+        no_ack_ = true;
+    } else if (packet.rfind("qXfer:features:read:target.xml:", 0) == 0) {
+        unsigned long offset, length;
+        if (!parse_range(packet, packet.rfind(':') + 1, offset, length)) {
+            send_packet("E01");
+            return;
+        }
+        std::string xml = target_xml();
+        if (offset >= xml.size()) {
+            send_packet("l");
+        } else {
+            std::string chunk = xml.substr(offset, length);
+            send_packet((offset + chunk.size() >= xml.size() ? "l" : "m") + chunk);
+        }
+    } else if (packet == "qAttached") {
+        send_packet("1");
+    } else if (packet == "qC") {
+        send_packet("QC1");
+    } else if (packet == "qfThreadInfo") {
+        send_packet("m1");
+    } else if (packet == "qsThreadInfo") {
+        send_packet("l");
+    } else if (packet == "vCont?") {
+        send_packet("vCont;c;C;s;S");
+    } else if (packet.rfind("vCont;", 0) == 0 && packet.size() > 6) {
+        // one thread, so the first action is the one that matters
+        char action = packet[6];
+        debugger.resume(chip8, action == 's' || action == 'S' ? 1 : 0);
+        running_ = true;
+    } else if (packet.rfind("vKill", 0) == 0) {
+        send_packet("OK");
+        close_client();
+        debugger.resume(chip8);
+    } else if (packet[0] == 'q' || packet[0] == 'Q' || packet[0] == 'v') {
+        send_packet("");
+    } else {
+        send_packet("E01");
+    }
+}
+
+void GdbStub::send_packet(const std::string &payload) {
+    unsigned checksum = 0;
+    for (char byte : payload) checksum += (std::uint8_t)byte;
+    char trailer[4];
+    snprintf(trailer, sizeof(trailer), "#%02x", checksum & 0xFF);
+    send_raw("$" + payload + trailer);
+}
+
+void GdbStub::send_raw(const std::string &data) {
+    std::size_t sent = 0;
+    while (sent < data.size() && client_ != -1) {
+        int result = send(client_, data.data() + sent, data.size() - sent, send_flags);
+        if (result > 0) {
+            sent += result;
+        } else if (result < 0 && would_block()) {
+            // replies are small, the kernel buffer only fills if the client stops reading
+            continue;
+        } else {
+            close_client();
+        }
+    }
+}
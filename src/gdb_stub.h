@@ -0,0 +1,50 @@
+#ifndef CHIP8_EMULATOR_GDB_STUB_H
+#define CHIP8_EMULATOR_GDB_STUB_H
+#include <cstdint>
+#include <string>
+#include "chip8.h"
+#include "debugger.h"
+
+// GDB remote serial protocol server on a loopback TCP port, so gdb or a
+// script can drive a Debugger. poll() never blocks: it is called from the
+// emulation thread between frames, runs the requests that have arrived and
+// reports stops, while the rom runs at full speed after a continue.
+//
+// Registers, in `g` order: V0-VF (8 bit), I (16 bit), PC (16 bit) and SP
+// (8 bit), little endian. Memory is the 4Kb address space. Breakpoints are
+// Z0/Z1, write, read and access watchpoints Z2/Z3/Z4. The layout is also
+// served as target.xml through qXfer:features:read.
+class GdbStub {
+public:
+    GdbStub() = default;
+    ~GdbStub();
+    GdbStub(const GdbStub &) = delete;
+    GdbStub &operator=(const GdbStub &) = delete;
+
+    // listens on 127.0.0.1:port for one client at a time
+    bool listen(int port);
+
+    void poll(Debugger &debugger, Chip8 &chip8);
+    bool connected() const { return client_ != -1; }
+
+    // why the last listen() failed
+    const std::string &error() const { return error_; }
+
+private:
+    void accept_client(Debugger &debugger);
+    void close_client();
+    void handle(const std::string &packet, Debugger &debugger, Chip8 &chip8);
+    void send_packet(const std::string &payload);
+    void send_raw(const std::string &data);
+    std::string stop_reply(const Debugger &debugger, const Chip8 &chip8) const;
+
+    std::intptr_t listener_ = -1;
+    std::intptr_t client_ = -1;
+    // bytes received and not yet parsed into packets
+    std::string input_;
+    bool no_ack_ = false;
+    // set by c and s, the stop they end in is reported when it happens
+    bool running_ = false;
+    std::string error_;
+};
+#endif //CHIP8_EMULATOR_GDB_STUB_H
@@ -0,0 +1,77 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "golden.h"
+#include "hash.h"
+
+FrameSnapshot snapshot_frame(const Chip8 &chip8, long long frame) {
+    FrameSnapshot snapshot;
+    snapshot.frame = frame;
+    if (chip8.megachip != nullptr && chip8.megachip->enabled()) {
+        const auto &pixels = chip8.megachip->frame();
+        snapshot.hash = xxh64(pixels.data(), pixels.size() * sizeof(pixels[0]));
+        return snapshot;
+    }
+
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 64; x++) {
+            if (chip8.screen[x][y]) snapshot.packed[y * 8 + x / 8] |= 0x80 >> (x % 8);
+        }
+    }
+    snapshot.hash = xxh64(snapshot.packed.data(), snapshot.packed.size());
+    snapshot.has_image = true;
+    return snapshot;
+}
+
+bool read_golden(const std::string &path, GoldenSet &golden) {
+    std::ifstream in(path);
+    if (!in) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string name, frame, hash, image;
+        if (!std::getline(fields, name, '\t') || !std::getline(fields, frame, '\t') ||
+            !std::getline(fields, hash, '\t') || !std::getline(fields, image)) continue;
+
+        FrameSnapshot snapshot;
+        snapshot.frame = std::atoll(frame.c_str());
+        snapshot.hash = std::strtoull(hash.c_str(), nullptr, 16);
+        if (image.size() == snapshot.packed.size() * 2) {
+            for (std::size_t i = 0; i < snapshot.packed.size(); i++) {
+                snapshot.packed[i] = (std::uint8_t)std::strtoul(image.substr(i * 2, 2).c_str(), nullptr, 16);
+            }
+            snapshot.has_image = true;
+        }
+        golden[{name, snapshot.frame}] = snapshot;
+    }
+    return true;
+}
+
+bool write_golden(const std::string &path, const GoldenSet &golden) {
+    std::ofstream out(path);
+    for (const auto &[key, snapshot] : golden) {
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)snapshot.hash);
+        out << key.first << '\t' << snapshot.frame << '\t' << hash << '\t';
+        if (snapshot.has_image) {
+            for (std::uint8_t byte : snapshot.packed) {
+                char digits[3];
+                snprintf(digits, sizeof(digits), "%02x", byte);
+                out << digits;
+            }
+        } else {
+            out << '-';
+        }
+        out << '\n';
+    }
+    return (bool)out;
+}
+
+bool write_pbm(const std::string &path, const std::array<std::uint8_t, 256> &packed) {
+    std::ofstream out(path, std::ios::binary);
+    out << "P4\n64 32\n";
+    out.write((const char *)packed.data(), packed.size());
+    return (bool)out;
+}
@@ -0,0 +1,33 @@
+#ifndef CHIP8_EMULATOR_GOLDEN_H
+#define CHIP8_EMULATOR_GOLDEN_H
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include "chip8.h"
+
+// What the machine showed after a given number of frames, for golden image
+// regression runs in the headless runner.
+struct FrameSnapshot {
+    long long frame = 0;
+    std::uint64_t hash = 0;
+    // the 64x32 screen, one bit a pixel, rows of 8 bytes with the leftmost
+    // pixel in the high bit (the PBM P4 layout); unused for MegaChip frames
+    std::array<std::uint8_t, 256> packed{};
+    bool has_image = false;
+};
+
+FrameSnapshot snapshot_frame(const Chip8 &chip8, long long frame);
+
+// golden snapshots keyed by rom name and frame
+using GoldenSet = std::map<std::pair<std::string, long long>, FrameSnapshot>;
+
+// Text file, one "<rom>\t<frame>\t<hash>\t<packed screen or ->" line per snapshot.
+// Reading a missing file fails, a malformed line is skipped.
+bool read_golden(const std::string &path, GoldenSet &golden);
+bool write_golden(const std::string &path, const GoldenSet &golden);
+
+// writes a 64x32 PBM image of a packed screen
+bool write_pbm(const std::string &path, const std::array<std::uint8_t, 256> &packed);
+#endif //CHIP8_EMULATOR_GOLDEN_H
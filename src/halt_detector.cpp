@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <cstring>
+#include "halt_detector.h"
+#include "hash.h"
+
+void StateHasher::reset() {
+    memory_version_ = ~0ull;
+    screen_version_ = ~0ull;
+}
+
+std::uint64_t StateHasher::hash(const Chip8 &chip8) {
+    if (chip8.memory_version != memory_version_) {
+        memory_hash_ = xxh64(chip8.memory.data(), chip8.memory.size());
+        memory_version_ = chip8.memory_version;
+    }
+    if (chip8.screen_version != screen_version_) {
+        screen_hash_ = xxh64(chip8.screen, sizeof(chip8.screen));
+        screen_version_ = chip8.screen_version;
+    }
+
+    // everything else that decides what the next frame does
+    std::uint8_t registers[128];
+    std::size_t size = 0;
+    auto add = [&](const void *data, std::size_t length) {
+        memcpy(registers + size, data, length);
+        size += length;
+    };
+    add(chip8.gpv_registers.data(), chip8.gpv_registers.size());
+    add(&chip8.index_register, sizeof(chip8.index_register));
+    add(&chip8.delay_timer, sizeof(chip8.delay_timer));
+    add(&chip8.sound_timer, sizeof(chip8.sound_timer));
+    add(chip8.stack.data(), sizeof(chip8.stack));
+    add(&chip8.stack_pointer, sizeof(chip8.stack_pointer));
+    add(&chip8.PC, sizeof(chip8.PC));
+    add(chip8.audio_pattern, sizeof(chip8.audio_pattern));
+    add(&chip8.audio_pitch, sizeof(chip8.audio_pitch));
+    add(&chip8.random_state, sizeof(chip8.random_state));
+    add(&chip8.vip_cycle_debt, sizeof(chip8.vip_cycle_debt));
+    add(&screen_hash_, sizeof(screen_hash_));
+    return xxh64(registers, size, memory_hash_);
+}
+
+void HaltDetector::reset() {
+    hasher_.reset();
+    history_.fill(0);
+    frames_ = 0;
+    period_ = 0;
+}
+
+bool HaltDetector::update(const Chip8 &chip8) {
+    std::uint64_t hash = hasher_.hash(chip8);
+    int known = frames_ < max_period ? frames_ : max_period;
+    for (int distance = 1; distance <= known; distance++) {
+        if (history_[(frames_ - distance) % max_period] == hash) {
+            period_ = distance;
+            return true;
+        }
+    }
+    history_[frames_ % max_period] = hash;
+    frames_++;
+    return false;
+}
+
+std::string HaltDetector::reason(const Chip8 &chip8) const {
+    std::uint16_t opcode = (chip8.memory[chip8.PC & 0xFFF] << 8) | chip8.memory[(chip8.PC + 1) & 0xFFF];
+    char text[96];
+    if ((opcode & 0xF0FF) == 0xF00A) {
+        snprintf(text, sizeof(text), "waiting for a key at 0x%03X", chip8.PC & 0xFFF);
+    } else if (period_ == 1) {
+        snprintf(text, sizeof(text), "stopped at 0x%03X", chip8.PC & 0xFFF);
+    } else {
+        snprintf(text, sizeof(text), "repeating every %d frames", period_);
+    }
+    return text;
+}
@@ -0,0 +1,49 @@
+#ifndef CHIP8_EMULATOR_HALT_DETECTOR_H
+#define CHIP8_EMULATOR_HALT_DETECTOR_H
+#include <array>
+#include <cstdint>
+#include <string>
+#include "chip8.h"
+
+// Hash of everything that decides what the machine does next, timers
+// included. Memory and the screen are only rehashed when their versions
+// change, so a hasher follows one machine; reset() it when that machine's
+// state is replaced wholesale.
+class StateHasher {
+public:
+    void reset();
+    std::uint64_t hash(const Chip8 &chip8);
+
+private:
+    std::uint64_t memory_version_ = ~0ull;
+    std::uint64_t screen_version_ = ~0ull;
+    std::uint64_t memory_hash_ = 0;
+    std::uint64_t screen_hash_ = 0;
+};
+
+// Notices when a rom has finished, for batch runs that would otherwise burn
+// their whole cycle budget on a 1NNN self jump or an FX0A nobody answers.
+// The state is hashed after every frame and the run counts as halted once a
+// hash repeats within the last few frames: with the keypad fixed, the same
+// state always leads to the same frames.
+class HaltDetector {
+public:
+    // longest repeating sequence of frames noticed
+    static constexpr int max_period = 16;
+
+    void reset();
+
+    // call after every frame, returns true once the machine has halted
+    bool update(const Chip8 &chip8);
+
+    // frames in the repeating sequence, 1 for a fixed point
+    int period() const { return period_; }
+    std::string reason(const Chip8 &chip8) const;
+
+private:
+    StateHasher hasher_;
+    std::array<std::uint64_t, max_period> history_{};
+    int frames_ = 0;
+    int period_ = 0;
+};
+#endif //CHIP8_EMULATOR_HALT_DETECTOR_H
@@ -0,0 +1,80 @@
+#include "hash.h"
+
+static const std::uint64_t prime_1 = 0x9E3779B185EBCA87ull;
+static const std::uint64_t prime_2 = 0xC2B2AE3D27D4EB4Full;
+static const std::uint64_t prime_3 = 0x165667B19E3779F9ull;
+static const std::uint64_t prime_4 = 0x85EBCA77C2B2AE63ull;
+static const std::uint64_t prime_5 = 0x27D4EB2F165667C5ull;
+
+static std::uint64_t rotl(std::uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// little endian whatever the host is, so hashes can be compared across machines
+static std::uint64_t read_u64(const std::uint8_t *p) {
+    std::uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static std::uint32_t read_u32(const std::uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
+}
+
+static std::uint64_t accumulate(std::uint64_t accumulator, std::uint64_t input) {
+    accumulator += input * prime_2;
+    return rotl(accumulator, 31) * prime_1;
+}
+
+static std::uint64_t merge_round(std::uint64_t hash, std::uint64_t accumulator) {
+    hash ^= accumulate(0, accumulator);
+    return hash * prime_1 + prime_4;
+}
+
+std::uint64_t xxh64(const void *data, std::size_t length, std::uint64_t seed) {
+    const std::uint8_t *p = (const std::uint8_t *)data;
+    const std::uint8_t *end = p + length;
+    std::uint64_t hash;
+
+    if (length >= 32) {
+        std::uint64_t v1 = seed + prime_1 + prime_2;
+        std::uint64_t v2 = seed + prime_2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - prime_1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = accumulate(v1, read_u64(p));
+            v2 = accumulate(v2, read_u64(p + 8));
+            v3 = accumulate(v3, read_u64(p + 16));
+            v4 = accumulate(v4, read_u64(p + 24));
+        }
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    } else {
+        hash = seed + prime_5;
+    }
+    hash += length;
+
+    for (; p + 8 <= end; p += 8) {
+        hash ^= accumulate(0, read_u64(p));
+        hash = rotl(hash, 27) * prime_1 + prime_4;
+    }
+    if (p + 4 <= end) {
+        hash ^= read_u32(p) * prime_1;
+        hash = rotl(hash, 23) * prime_2 + prime_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= *p * prime_5;
+        hash = rotl(hash, 11) * prime_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime_2;
+    hash ^= hash >> 29;
+    hash *= prime_3;
+    hash ^= hash >> 32;
+    return hash;
+}
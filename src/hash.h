@@ -0,0 +1,9 @@
+#ifndef CHIP8_EMULATOR_HASH_H
+#define CHIP8_EMULATOR_HASH_H
+#include <cstddef>
+#include <cstdint>
+
+// XXH64, for framebuffer and machine state hashes that are stable across
+// hosts and fast enough to take every frame.
+std::uint64_t xxh64(const void *data, std::size_t length, std::uint64_t seed = 0);
+#endif //CHIP8_EMULATOR_HASH_H
@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "block_cache.h"
+#include "chip8.h"
+#include "golden.h"
+#include "halt_detector.h"
+#include "megachip.h"
+#include "profiler.h"
+#include "rom_pack.h"
+#include "stats.h"
+#include "trace.h"
+
+// Runs every rom in a rom file, tar, stored zip or C8PK pack without a window,
+// for regression runs over large rom corpora.
+
+// Every heap allocation in this binary is counted so --check-allocs can prove
+// the interpreter's run loop never touches the allocator.
+static std::atomic<std::uint64_t> allocation_count{0};
+
+void *operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// set by SIGUSR1, the run loop prints the running rom's stats
+static volatile std::sig_atomic_t stats_requested = 0;
+
+// pack entry names can contain directories
+static std::string file_safe(std::string_view name) {
+    std::string safe(name);
+    for (char &c : safe) {
+        if (!std::isalnum((unsigned char)c) && c != '.' && c != '-') c = '_';
+    }
+    return safe;
+}
+
+static void show_headless_usage(const std::string &name) {
+    std::cerr << "Usage: " << name << " <rom or pack> <option(s)>\n"
+              << "       " << name << " --make-pack <out.c8pk> <rom(s)>\n"
+              << "Options:\n"
+              << "\t-h,--help\t\tShow this help message\n"
+              << "\t--cycles <n>\t\tInstructions to run per rom (default 1000000)\n"
+              << "\t--ipf <n>\t\tInstructions per 60hz frame, timers tick once per frame (default 12)\n"
+              << "\t--check-allocs\t\tFail if running a rom allocates any heap memory\n"
+              << "\t--no-idle-skip\t\tRun polling loops instruction by instruction instead of skipping to the next frame\n"
+              << "\t--fuse\t\t\tExecute common opcode sequences as superinstructions\n"
+              << "\t--tiered\t\tCompile hot straight line code into pre-decoded blocks\n"
+              << "\t--megachip\t\tRun roms as MegaChip8, roms larger than 4Kb always are\n"
+              << "\t--vip-timing\t\tSize frames in COSMAC VIP cycles, --cycles still counts --ipf per frame\n"
+              << "\t--bench\t\t\tReport instructions per second and the superinstruction hit rate\n"
+              << "\t--rom <name>\t\tOnly run the pack entry with this name\n"
+              << "\t--stop-when-halted\tEnd a rom's run once its state stops changing or repeats\n"
+              << "\t--hash-at <n,...>\tHash the screen after these frames as well as after the last one\n"
+              << "\t--golden <file>\t\tCompare screen hashes with this file, or create it when it doesn't exist\n"
+              << "\t--update-golden\t\tRewrite the golden file from this run instead of comparing\n"
+              << "\t--diff-dir <dir>\tWhere to write PBM images of mismatching screens (default .)\n"
+              << "\t--trace <file>\t\tRecord every instruction to a binary trace (see chip8-trace), <file>.<rom> for several roms\n"
+              << "\t--profile <file>\tWrite a callgrind profile of the rom's subroutines, <file>.<rom> for several roms\n"
+              << "\t--stats <file>\t\tWrite every rom's opcode mix, draws, frames, timer ticks and input polls as JSON\n"
+              << "\t-chip48\t\t\tUse the original COSMAC VIP shift and jump behaviour"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        show_headless_usage(argv[0]);
+        return 1;
+    }
+
+    std::string first = argv[1];
+    if (first == "-h" || first == "--help") {
+        show_headless_usage(argv[0]);
+        return 0;
+    }
+    if (first == "--make-pack") {
+        if (argc < 4) {
+            show_headless_usage(argv[0]);
+            return 1;
+        }
+        std::vector<std::string> roms(argv + 3, argv + argc);
+        if (!write_rom_pack(argv[2], roms)) {
+            std::cerr << "failed to write pack " << argv[2] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    long long cycles = 1000000;
+    int ipf = 12;
+    std::string only_rom;
+    bool chip48_mode = true;
+    bool check_allocs = false;
+    bool skip_idle_loops = true;
+    bool fuse = false;
+    bool tiered = false;
+    bool vip_timing = false;
+    bool force_megachip = false;
+    bool bench = false;
+    bool stop_when_halted = false;
+    std::vector<long long> hash_at;
+    std::string golden_path;
+    bool update_golden = false;
+    std::string diff_dir = ".";
+    std::string trace_path;
+    std::string profile_path;
+    std::string stats_path;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cycles" && i + 1 < argc) {
+            cycles = std::atoll(argv[++i]);
+        } else if (arg == "--ipf" && i + 1 < argc) {
+            ipf = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--rom" && i + 1 < argc) {
+            only_rom = argv[++i];
+        } else if (arg == "--check-allocs") {
+            check_allocs = true;
+        } else if (arg == "--no-idle-skip") {
+            skip_idle_loops = false;
+        } else if (arg == "--fuse") {
+            fuse = true;
+        } else if (arg == "--tiered") {
+            tiered = true;
+        } else if (arg == "--megachip") {
+            force_megachip = true;
+        } else if (arg == "--vip-timing") {
+            vip_timing = true;
+        } else if (arg == "--bench") {
+            bench = true;
+        } else if (arg == "--stop-when-halted") {
+            stop_when_halted = true;
+        } else if (arg == "--hash-at" && i + 1 < argc) {
+            std::istringstream frames(argv[++i]);
+            std::string frame;
+            while (std::getline(frames, frame, ',')) {
+                if (std::atoll(frame.c_str()) > 0) hash_at.push_back(std::atoll(frame.c_str()));
+            }
+        } else if (arg == "--golden" && i + 1 < argc) {
+            golden_path = argv[++i];
+        } else if (arg == "--update-golden") {
+            update_golden = true;
+        } else if (arg == "--diff-dir" && i + 1 < argc) {
+            diff_dir = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (arg == "--stats" && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (arg == "-chip48") {
+            chip48_mode = false;
+        }
+    }
+
+    // the tracer and profiler each drive run_frame() with their own hooks, a
+    // frame only runs with one of them
+    if (!trace_path.empty() && !profile_path.empty()) {
+        std::cerr << "--profile can't be used with --trace" << std::endl;
+        return 1;
+    }
+
+    RomPack pack;
+    if (!pack.open(first)) {
+        std::cerr << pack.error() << std::endl;
+        return 1;
+    }
+
+    std::sort(hash_at.begin(), hash_at.end());
+    hash_at.erase(std::unique(hash_at.begin(), hash_at.end()), hash_at.end());
+
+    // without a golden file to compare with, this run's snapshots become it
+    GoldenSet golden;
+    GoldenSet recorded;
+    bool compare_golden = !golden_path.empty() && !update_golden && read_golden(golden_path, golden);
+    bool hashing = !golden_path.empty() || !hash_at.empty();
+    std::vector<FrameSnapshot> snapshots;
+    snapshots.reserve(hash_at.size() + 1);
+
+    // one machine is reused for the whole pack, reset() is cheap compared to a fresh allocation
+    Chip8 chip8;
+    BlockCache block_cache;
+    // 16Mb, only allocated once a pack has a MegaChip rom
+    std::unique_ptr<MegaChip> megachip;
+    HaltDetector halt_detector;
+    TraceRecorder trace;
+    // 64Kb of counters, kept off the stack
+    std::unique_ptr<Profiler> profiler;
+    if (!profile_path.empty()) profiler = std::make_unique<Profiler>();
+    bool file_per_rom = only_rom.empty() && pack.entries().size() > 1;
+    std::vector<std::pair<std::string, RuntimeStats>> rom_stats;
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, [](int) { stats_requested = 1; });
+#endif
+    int failures = 0;
+    for (const RomEntry &entry : pack.entries()) {
+        if (!only_rom.empty() && entry.name != only_rom) continue;
+
+        chip8.reset();
+        chip8.chip48_mode = chip48_mode;
+        chip8.skip_idle_loops = skip_idle_loops;
+        chip8.fuse = fuse;
+        chip8.vip_timing = vip_timing;
+        chip8.cycle_count = 0;
+        chip8.elided_cycles = 0;
+        chip8.fused_count = 0;
+        chip8.fused_cycles = 0;
+        chip8.stats = {};
+        block_cache.clear();
+        block_cache.promotions = 0;
+        block_cache.demotions = 0;
+        block_cache.block_cycles = 0;
+        chip8.block_cache = tiered ? &block_cache : nullptr;
+        chip8.megachip = nullptr;
+        bool loaded;
+        if (force_megachip || entry.data.size() > chip8.memory.size() - 0x200) {
+            if (!megachip) megachip = std::make_unique<MegaChip>();
+            chip8.megachip = megachip.get();
+            loaded = megachip->load_rom(chip8, entry.data.data(), entry.data.size());
+        } else {
+            loaded = chip8.load_rom(entry.data.data(), entry.data.size());
+        }
+        if (!loaded) {
+            std::cerr << entry.name << ": rom too large (" << entry.data.size() << " bytes)" << std::endl;
+            failures++;
+            continue;
+        }
+
+        // tracing and profiling follow run_frame()'s instruction hooks, which
+        // neither MegaChip nor VIP timing frames call
+        if ((!trace_path.empty() || profiler) && (vip_timing || chip8.megachip != nullptr)) {
+            std::cerr << entry.name << ": --trace and --profile can't be used with --vip-timing or MegaChip roms"
+                      << std::endl;
+            failures++;
+            continue;
+        }
+
+        bool tracing = !trace_path.empty();
+        if (tracing && !trace.open(file_per_rom ? trace_path + "." + file_safe(entry.name) : trace_path, chip8)) {
+            std::cerr << trace.error() << std::endl;
+            return 1;
+        }
+
+        if (profiler) profiler->reset();
+
+        std::uint64_t allocations_before = allocation_count.load();
+        auto start = std::chrono::steady_clock::now();
+        long long frame = 0;
+        std::size_t next_hash = 0;
+        snapshots.clear();
+        // MegaChip memory is outside the state the detector hashes
+        bool detect_halt = stop_when_halted && chip8.megachip == nullptr;
+        bool halted = false;
+        halt_detector.reset();
+        for (long long cycle = 0; cycle < cycles; cycle += ipf) {
+            if (tracing) trace.run_frame(chip8, ipf);
+            else if (profiler) chip8.run_frame(ipf, *profiler);
+            else chip8.run_frame(ipf);
+            frame++;
+            if (stats_requested) {
+                stats_requested = 0;
+                std::cerr << entry.name << " at frame " << frame << ": " << format_stats(chip8.stats) << std::flush;
+            }
+            if (next_hash < hash_at.size() && hash_at[next_hash] == frame) {
+                snapshots.push_back(snapshot_frame(chip8, frame));
+                next_hash++;
+            }
+            if (detect_halt && halt_detector.update(chip8)) {
+                halted = true;
+                break;
+            }
+        }
+        if (hashing && (snapshots.empty() || snapshots.back().frame != frame)) {
+            snapshots.push_back(snapshot_frame(chip8, frame));
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::uint64_t allocations = allocation_count.load() - allocations_before;
+        if (tracing) {
+            trace.close();
+            if (!trace.error().empty()) {
+                std::cerr << entry.name << ": " << trace.error() << std::endl;
+                failures++;
+            }
+        }
+
+        if (check_allocs && allocations != 0) {
+            std::cerr << entry.name << ": " << allocations << " heap allocations during the run" << std::endl;
+            failures++;
+        }
+
+        std::cout << entry.name << ": pc 0x" << std::hex << chip8.PC << std::dec
+                  << ", " << chip8.cycle_count << " cycles run, " << chip8.elided_cycles << " idle cycles skipped\n";
+        if (tracing) {
+            std::cout << "  traced " << trace.instructions() << " instructions in " << trace.bytes() << " bytes\n";
+        }
+        if (profiler) {
+            std::string path = file_per_rom ? profile_path + "." + file_safe(entry.name) : profile_path;
+            if (profiler->write_callgrind(path, std::string(entry.name))) {
+                std::cout << "  profiled " << profiler->instructions() << " instructions into " << path << "\n";
+            } else {
+                std::cerr << entry.name << ": could not write " << path << std::endl;
+                failures++;
+            }
+        }
+        if (!stats_path.empty()) rom_stats.emplace_back(entry.name, chip8.stats);
+        if (halted) {
+            std::cout << "  halted after " << frame << " frames, " << halt_detector.reason(chip8) << "\n";
+        }
+        if (bench) {
+            double seconds = elapsed.count();
+            double hit_rate = chip8.cycle_count == 0 ? 0 : 100.0 * chip8.fused_cycles / chip8.cycle_count;
+            std::cout << "  " << seconds * 1000 << " ms, " << (seconds > 0 ? chip8.cycle_count / seconds / 1e6 : 0) << " MIPS, "
+                      << chip8.fused_count << " superinstructions covering " << hit_rate << "% of cycles\n";
+            if (tiered) {
+                double block_rate = chip8.cycle_count == 0 ? 0 : 100.0 * block_cache.block_cycles / chip8.cycle_count;
+                std::cout << "  " << block_cache.promotions << " blocks compiled, " << block_cache.demotions
+                          << " demoted by stores, " << block_rate << "% of cycles run from blocks\n";
+            }
+        }
+
+        for (const FrameSnapshot &snapshot : snapshots) {
+            char hash[17];
+            snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)snapshot.hash);
+            if (!compare_golden) {
+                if (golden_path.empty()) std::cout << "  frame " << snapshot.frame << ": " << hash << "\n";
+                recorded[{std::string(entry.name), snapshot.frame}] = snapshot;
+                continue;
+            }
+
+            auto expected = golden.find({std::string(entry.name), snapshot.frame});
+            if (expected == golden.end()) {
+                std::cerr << entry.name << ": no golden screen for frame " << snapshot.frame << std::endl;
+                failures++;
+            } else if (expected->second.hash != snapshot.hash) {
+                std::cerr << entry.name << ": frame " << snapshot.frame << " screen hash " << hash << " doesn't match the golden one" << std::endl;
+                failures++;
+                if (snapshot.has_image && expected->second.has_image) {
+                    std::string base = diff_dir + "/" + file_safe(entry.name) + "_" + std::to_string(snapshot.frame);
+                    std::array<std::uint8_t, 256> diff;
+                    for (std::size_t i = 0; i < diff.size(); i++) {
+                        diff[i] = snapshot.packed[i] ^ expected->second.packed[i];
+                    }
+                    write_pbm(base + "_actual.pbm", snapshot.packed);
+                    write_pbm(base + "_expected.pbm", expected->second.packed);
+                    write_pbm(base + "_diff.pbm", diff);
+                }
+            }
+        }
+    }
+
+    if (!golden_path.empty() && !compare_golden) {
+        if (!write_golden(golden_path, recorded)) {
+            std::cerr << "failed to write golden file " << golden_path << std::endl;
+            return 1;
+        }
+        std::cout << "wrote " << recorded.size() << " golden screens to " << golden_path << "\n";
+    }
+
+    if (!stats_path.empty()) {
+        std::ofstream out(stats_path);
+        out << "{\n  \"roms\": [";
+        for (std::size_t i = 0; i < rom_stats.size(); i++) {
+            std::string name;
+            for (char c : rom_stats[i].first) {
+                if (c == '"' || c == '\\') name += '\\';
+                name += c;
+            }
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << name << "\", \"stats\": ";
+            write_stats_json(out, rom_stats[i].second, 4);
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+        if (!out) {
+            std::cerr << "failed to write stats to " << stats_path << std::endl;
+            return 1;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
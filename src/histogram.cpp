@@ -0,0 +1,25 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "histogram.h"
+
+std::uint64_t LatencyHistogram::percentile(double percent) const {
+    std::uint64_t total = count();
+    if (total == 0) return 0;
+    std::uint64_t rank = std::max<std::uint64_t>(1, (std::uint64_t)std::ceil(total * percent / 100));
+    std::uint64_t seen = 0;
+    for (int bucket = 0; bucket < bucket_count; bucket++) {
+        seen += counts_[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) return std::min(bucket_top(bucket), max());
+    }
+    // the counts moved on while they were read
+    return max();
+}
+
+std::string LatencyHistogram::summary() const {
+    char text[128];
+    snprintf(text, sizeof(text), "p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms (%llu samples)",
+             percentile(50) / 1e6, percentile(99) / 1e6, percentile(99.9) / 1e6, max() / 1e6,
+             (unsigned long long)count());
+    return text;
+}
@@ -0,0 +1,58 @@
+#ifndef CHIP8_EMULATOR_HISTOGRAM_H
+#define CHIP8_EMULATOR_HISTOGRAM_H
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <string>
+
+// Log-bucketed histogram of durations in nanoseconds, in the style of
+// HdrHistogram: every power of two is split into 16 linear buckets, so a
+// percentile is reported to within 1/16 of its value over the whole range
+// from 1ns up, in a fixed 8Kb of counters. Recording is one bucket
+// increment; it never allocates or locks. One thread records, any other
+// thread can read the percentiles while it does.
+class LatencyHistogram {
+public:
+    void record(std::uint64_t nanoseconds) {
+        std::atomic<std::uint64_t> &bucket = counts_[bucket_of(nanoseconds)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total_.store(total_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (nanoseconds > max_.load(std::memory_order_relaxed)) max_.store(nanoseconds, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    std::uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    // the value `percent` of the samples are at or below, rounded up to the
+    // top of its bucket; 0 without samples
+    std::uint64_t percentile(double percent) const;
+
+    // p50, p99, p99.9 and the max in milliseconds, and the sample count
+    std::string summary() const;
+
+private:
+    static constexpr int sub_bits = 4;
+    static constexpr int sub_count = 1 << sub_bits;
+    // values below sub_count get a bucket each, then sub_count per power of two
+    static constexpr int bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    static constexpr int bucket_of(std::uint64_t value) {
+        if (value < sub_count) return (int)value;
+        int shift = (int)std::bit_width(value) - sub_bits - 1;
+        return (shift + 1) * sub_count + (int)((value >> shift) - sub_count);
+    }
+
+    // the largest value that lands in `bucket`
+    static constexpr std::uint64_t bucket_top(int bucket) {
+        if (bucket < sub_count) return bucket;
+        int shift = bucket / sub_count - 1;
+        std::uint64_t mantissa = bucket % sub_count + sub_count;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::array<std::atomic<std::uint64_t>, bucket_count> counts_{};
+    std::atomic<std::uint64_t> total_{0};
+    std::atomic<std::uint64_t> max_{0};
+};
+#endif //CHIP8_EMULATOR_HISTOGRAM_H
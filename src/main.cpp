@@ -1,20 +1,150 @@
 #include <iostream>
 #include <vector>
 #include <SDL.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
-#include <fstream>
+#include <cstdio>
+#include <cmath>
 #include <cstdlib>
 #include <thread>
 #include <chrono>
+#include <csignal>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
 #include "utils.h"
+#include "chip8.h"
+#include "rom_pack.h"
+#include "audio.h"
+#include "triple_buffer.h"
+#include "pacer.h"
+#include "block_cache.h"
+#include "megachip.h"
+#include "overlay.h"
+#include "profiler.h"
+#include "debugger.h"
+#include "gdb_stub.h"
+#include "histogram.h"
+#include "stats.h"
+#include "trace.h"
+#include "zones.h"
 #include "main.h"
+#ifdef CHIP8_AOT
+#include "aot.h"
+#endif
 
 bool DEBUG = false;
 bool CHIP48_MODE = true;
 
+// host key for each chip8 key value 0x0 - 0xF
+const SDL_Scancode keymap[16] = {
+        SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+        SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+        SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+        SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V
+};
+
+const int sample_rate = 44100;
+
+// filled by the emulation loop, drained by the audio callback
+SampleRing audio_ring;
+
+struct Frame {
+    bool screen[64][32];
+    // set while a MegaChip rom is in MegaChip mode, pixels replace screen
+    bool megachip;
+    std::uint32_t pixels[MegaChip::width * MegaChip::height];
+    // timestamp() when it was published, and of the keypad change it is
+    // the first frame to show a response to, 0 if none
+    std::int64_t published_at;
+    std::int64_t input_at;
+};
+
+// completed frames, published by the emulation thread and presented by the SDL thread
+TripleBuffer<Frame> frames;
+
+// the interpreter's counters as of the last frame, published by the emulation thread
+TripleBuffer<RuntimeStats> runtime_stats;
+// the emulation thread's time per frame, from a frame being published to it
+// being presented, and from a keypad change to the first presented frame
+// whose screen changed after it; printed at exit and with SIGUSR1
+LatencyHistogram frame_time;
+LatencyHistogram present_latency;
+LatencyHistogram input_latency;
+
+// set by SIGUSR1, the SDL thread prints runtime_stats and the latencies
+volatile std::sig_atomic_t stats_requested = 0;
+
+// state shared between the SDL thread and the emulation thread
+std::atomic<bool> running{true};
+// bit n set while chip8 key n is held, and the timestamp() it last changed at
+std::atomic<std::uint16_t> key_mask{0};
+std::atomic<std::int64_t> key_changed_at{0};
+// debugger command lines typed on stdin
+std::mutex debug_mutex;
+std::vector<std::string> debug_commands;
+// a key release in the window, steps once if the debugger is paused
+std::atomic<bool> debug_key_step{false};
+// set with --gdb, serves the debugger to gdb as well as the console
+GdbStub *gdb_stub = nullptr;
+// set with --trace, records every instruction the emulation thread runs
+TraceRecorder *trace_recorder = nullptr;
+// set with --profile, counts the instructions and calls the emulation thread runs
+Profiler *profiler = nullptr;
+// toggled with tab, runs the interpreter as fast as the host allows
+std::atomic<bool> turbo{false};
+
+// multiple of the normal instruction rate set with --speed, 0 means unlimited
+double speed = 1.0;
+
+// instructions per 60hz frame, set with --ipf or --hz (700hz by default)
+int ipf = 12;
+
+bool skip_idle_loops = true;
+bool fuse = false;
+bool tiered = false;
+bool vip_timing = false;
+bool force_megachip = false;
+// --overlay starts with the performance overlay shown, F1 toggles it
+bool show_overlay = false;
+
+// created the first time a MegaChip frame is drawn
+SDL_Texture *megachip_texture = nullptr;
+
+void audio_callback(void *, Uint8 *stream, int len) {
+    // SDL owns the audio thread, so it is named from here
+    zones_name_thread("audio");
+    CHIP8_ZONE("audio callback");
+    std::int16_t *samples = (std::int16_t *)stream;
+    std::size_t count = len / sizeof(std::int16_t);
+    std::size_t read = audio_ring.read(samples, count);
+    // underrun, play silence rather than wait for the emulator
+    for (std::size_t i = read; i < count; i++) {
+        samples[i] = 0;
+    }
+}
+
+SDL_AudioDeviceID init_audio() {
+    SDL_AudioSpec want{};
+    want.freq = sample_rate;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 512;
+    want.callback = audio_callback;
+
+    SDL_AudioDeviceID device = SDL_OpenAudioDevice(nullptr, 0, &want, nullptr, 0);
+    if (device == 0) {
+        std::cerr << "could not open audio device: " << SDL_GetError() << std::endl;
+        return 0;
+    }
+    SDL_PauseAudioDevice(device, 0);
+    return device;
+}
+
 void init_SDL2() {
-    SDL_Init(SDL_INIT_VIDEO);
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
     window = SDL_CreateWindow("", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64 * scale, 32 * scale, 0);
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
@@ -25,386 +155,482 @@ void init_SDL2() {
     SDL_SetRenderDrawColor(renderer, 0, 255, 255, 255);
 }
 
+void draw_screen(const bool screen[64][32]) {
+    SDL_RenderSetLogicalSize(renderer, 64, 32);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    SDL_SetRenderDrawColor(renderer, 0, 255, 255, 255);
+    for (int i = 0; i < 64; i++) {
+        for (int k = 0; k < 32; k++) {
+            if (screen[i][k] == 1) {
+                SDL_RenderDrawPoint(renderer, i, k);
+            }
+        }
+    }
+}
+
+void draw_megachip_screen(const std::uint32_t *pixels) {
+    if (megachip_texture == nullptr) {
+        megachip_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                             MegaChip::width, MegaChip::height);
+    }
+    SDL_RenderSetLogicalSize(renderer, MegaChip::width, MegaChip::height);
+    SDL_UpdateTexture(megachip_texture, nullptr, pixels, MegaChip::width * sizeof(std::uint32_t));
+    SDL_RenderCopy(renderer, megachip_texture, nullptr, nullptr);
+}
+
+// steady clock nanoseconds, for timestamps handed between threads
+std::int64_t timestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void print_latencies() {
+    std::cout << "frame time: " << frame_time.summary() << "\n"
+              << "present latency: " << present_latency.summary() << "\n"
+              << "input latency: " << input_latency.summary() << std::endl;
+}
+
+// the screen as last published, to find the first frame that changes after a key does
+bool published_screen[64][32];
+
+// `pending_input` is the keypad change no published frame has responded to
+// yet, handed on to the frame if its screen changed
+void publish_frame(Chip8 &chip8, std::int64_t &pending_input) {
+    Frame &frame = frames.back();
+    frame.megachip = chip8.megachip != nullptr && chip8.megachip->enabled();
+    bool changed = true;
+    if (frame.megachip) {
+        std::copy(chip8.megachip->frame().begin(), chip8.megachip->frame().end(), frame.pixels);
+    } else {
+        memcpy(frame.screen, chip8.screen, sizeof(chip8.screen));
+        changed = memcmp(published_screen, chip8.screen, sizeof(chip8.screen)) != 0;
+        memcpy(published_screen, chip8.screen, sizeof(chip8.screen));
+    }
+    frame.input_at = changed ? pending_input : 0;
+    if (changed) pending_input = 0;
+    frame.published_at = timestamp();
+    frames.publish();
+    chip8.draw_flag = false;
+}
+
+// Called after a frame with the draw_flag from before it. A frame that draws
+// over a picture no frame has published yet drops that picture, which counts
+// as a skipped frame; one that doesn't draw leaves the picture pending.
+void count_skipped_frame(Chip8 &chip8, bool unshown) {
+    if (!chip8.draw_flag) chip8.draw_flag = unshown;
+    else if (unshown) chip8.stats.skipped_frames++;
+}
+
+void emulation_loop(Chip8 &chip8, Beeper &beeper, bool audio, int refresh_rate) {
+    using clock = FramePacer::clock;
+    const auto frame_period = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(1.0 / (60 * (speed > 0 ? speed : 1.0))));
+    const auto present_interval = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(1.0 / refresh_rate));
+
+    FramePacer pacer;
+    auto deadline = clock::now();
+    auto last_publish = deadline;
+    // frames run since the clock was last read
+    int unpaced = 0;
+    Debugger debugger;
+    std::uint16_t last_keys = 0;
+    std::int64_t pending_input = 0;
+    zones_name_thread("emulation");
+    if (DEBUG) std::cout << "paused, c to continue, s to step" << std::endl;
+
+    while (running.load(std::memory_order_relaxed)) {
+        std::uint16_t keys = key_mask.load(std::memory_order_acquire);
+        if (keys != last_keys) {
+            // a later change before the screen responds is part of the same wait
+            if (pending_input == 0) pending_input = key_changed_at.load(std::memory_order_relaxed);
+            last_keys = keys;
+        }
+        for (int key = 0; key < 16; key++) {
+            chip8.keys[key] = (keys >> key) & 1;
+        }
+
+        if (DEBUG) {
+            if (gdb_stub != nullptr) gdb_stub->poll(debugger, chip8);
+            std::vector<std::string> commands;
+            {
+                std::lock_guard<std::mutex> lock(debug_mutex);
+                commands.swap(debug_commands);
+            }
+            for (const std::string &command : commands) {
+                std::cout << debugger.command(chip8, command) << std::flush;
+            }
+            // a running rom ignores it, stepping would pause it
+            if (debug_key_step.exchange(false, std::memory_order_relaxed) && debugger.paused()) {
+                std::cout << debugger.command(chip8, "s") << std::flush;
+            }
+            if (debugger.paused()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                deadline = clock::now();
+                continue;
+            }
+        }
+
+        bool unlimited = speed == 0 || turbo.load(std::memory_order_relaxed);
+        bool fast = unlimited || speed != 1.0;
+
+        if (audio && !fast) {
+            CHIP8_ZONE("audio fill");
+            beeper.emit(chip8, 1, 60);
+        }
+
+        bool unshown = chip8.draw_flag;
+        chip8.draw_flag = false;
+        {
+            CHIP8_ZONE("instruction batch");
+            std::int64_t batch_start = timestamp();
+            if (DEBUG) {
+                // the frame is only partly run when the debugger stops inside it
+                debugger.run_frame(chip8, ipf);
+                if (debugger.paused()) {
+                    std::cout << "stopped at frame " << debugger.frames() << " (" << debugger.reason() << ")\n"
+                              << debugger.registers(chip8) << std::flush;
+                    count_skipped_frame(chip8, unshown);
+                    if (chip8.draw_flag) publish_frame(chip8, pending_input);
+                    continue;
+                }
+            } else if (trace_recorder != nullptr) {
+                trace_recorder->run_frame(chip8, ipf);
+            } else if (profiler != nullptr) {
+                chip8.run_frame(ipf, *profiler);
+            } else {
+                chip8.run_frame(ipf);
+            }
+            frame_time.record(timestamp() - batch_start);
+        }
+        count_skipped_frame(chip8, unshown);
+        runtime_stats.back() = chip8.stats;
+        runtime_stats.publish();
+
+        // reading the clock every frame would dominate an unlimited run, so check it in batches
+        if (unlimited && ++unpaced < 16) continue;
+        unpaced = 0;
+
+        // at normal speed every frame that drew is published, faster than
+        // that the frames in between two display refreshes are skipped
+        auto now = clock::now();
+        if (chip8.draw_flag && (!fast || now - last_publish >= present_interval)) {
+            CHIP8_ZONE("framebuffer publish");
+            publish_frame(chip8, pending_input);
+            last_publish = now;
+        }
+
+        if (unlimited) {
+            deadline = now;
+            continue;
+        }
+
+        deadline += frame_period;
+        if (now - deadline > std::chrono::milliseconds(100)) {
+            // fell far behind, don't sprint to catch up
+            deadline = now;
+        } else {
+            CHIP8_ZONE("pace wait");
+            pacer.wait_until(deadline);
+        }
+    }
+}
+
 int main(int argc, char* argv[]) {
-    int PC = 0x200;
-    
-    char *file_dir;
-    for (int i = 1; i < argc; i++) {
+#ifdef CHIP8_AOT
+    // the rom is compiled in, every argument is an option
+    const int first_option = 1;
+#else
+    const int first_option = 2;
+    char *file_dir = argc > 1 ? argv[1] : nullptr;
+#endif
+    std::string rom_name;
+    int gdb_port = 0;
+    std::string trace_path;
+    std::string profile_path;
+    std::string zones_path;
+    for (int i = first_option; i < argc; i++) {
         std::string arg = argv[i];
-        if (i == 1) {
-            file_dir = argv[i];
-        } else if ((arg == "-d") || (arg == "--debug")) {
+        if ((arg == "-d") || (arg == "--debug")) {
+            DEBUG = true;
+        } else if (arg == "--gdb" && i + 1 < argc) {
             DEBUG = true;
+            gdb_port = std::atoi(argv[++i]);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_path = argv[++i];
         } else if ((arg == "-h") || (arg == "--help")) {
             show_usage(argv[0]);
             return 0;
         }  else if (arg == "-chip48") {
             CHIP48_MODE = false;
+        } else if (arg == "--rom" && i + 1 < argc) {
+            rom_name = argv[++i];
+        } else if (arg == "--speed" && i + 1 < argc) {
+            std::string value = argv[++i];
+            // 0 is unlimited, which has to be asked for by name
+            char *end = nullptr;
+            speed = value == "unlimited" ? 0 : std::strtod(value.c_str(), &end);
+            if (value != "unlimited" && (end == value.c_str() || *end != '\0' || !std::isfinite(speed) || speed <= 0)) {
+                std::cerr << "--speed takes a number above 0 or 'unlimited', not " << value << std::endl;
+                return 1;
+            }
+        } else if (arg == "--overlay") {
+            show_overlay = true;
+        } else if (arg == "--zones" && i + 1 < argc) {
+            zones_path = argv[++i];
+            if (!zones_enabled) {
+                std::cerr << "--zones needs a build configured with -DCHIP8_ZONES=ON" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--tiered") {
+            tiered = true;
+        } else if (arg == "--vip-timing") {
+            vip_timing = true;
+        } else if (arg == "--megachip") {
+            force_megachip = true;
+        } else if (arg == "--fuse") {
+            fuse = true;
+        } else if (arg == "--no-idle-skip") {
+            skip_idle_loops = false;
+        } else if (arg == "--ipf" && i + 1 < argc) {
+            ipf = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--hz" && i + 1 < argc) {
+            ipf = std::max(1, (std::atoi(argv[++i]) + 30) / 60);
         }
     }
 
-    // 4Kb of memory
-    std::vector<std::uint8_t> memory(4096, 0);
-    std::fill(memory.begin(), memory.end(), 0);
-
-    // general-purpose variable registers
-    std::vector<std::uint8_t> gpv_registers(16, 0);
-    std::fill(gpv_registers.begin(), gpv_registers.end(), 0);
-
-    // index register
-    std::uint16_t index_register = 0;
-
-    // delay timer
-    std::uint8_t delay_timer = 0;
-
-    // sound timer
-    std::uint16_t sound_timer = 0;
-
-    // stack
-    std::vector<std::uint16_t> stack(0, 0);
+#ifndef CHIP8_AOT
+    if (file_dir == nullptr) {
+        show_usage(argv[0]);
+        return 1;
+    }
 
     /// Load game
-    std::ifstream input(file_dir, std::ios::binary);
-    // copies all data into buffer
-    std::vector<std::uint8_t> buffer(std::istreambuf_iterator<char>(input), {});
-
-    for (int i = 0; i < buffer.size(); i++) {
-        memory[i + 0x200] = buffer[i];
+    RomPack pack;
+    if (!pack.open(file_dir)) {
+        std::cerr << pack.error() << std::endl;
+        return 1;
+    }
+    const RomEntry *rom = rom_name.empty() ? (pack.entries().empty() ? nullptr : &pack.entries().front())
+                                           : pack.find(rom_name);
+    if (rom == nullptr) {
+        std::cerr << "no rom to load in " << file_dir << std::endl;
+        return 1;
     }
+#endif
+
+    Chip8 chip8;
+    chip8.reset();
+    chip8.chip48_mode = CHIP48_MODE;
+    chip8.skip_idle_loops = skip_idle_loops;
+    chip8.fuse = fuse;
+    chip8.vip_timing = vip_timing;
+    BlockCache block_cache;
+    if (tiered) chip8.block_cache = &block_cache;
+#ifdef CHIP8_AOT
+    chip8.native_code = chip8_aot_run;
+    if (!chip8.load_rom(chip8_aot_rom, chip8_aot_rom_size)) {
+        std::cerr << "the compiled in rom is too large to fit in memory" << std::endl;
+        return 1;
+    }
+#else
+    // roms too large for 4Kb can only be MegaChip roms
+    std::unique_ptr<MegaChip> megachip;
+    if (force_megachip || rom->data.size() > chip8.memory.size() - 0x200) {
+        megachip = std::make_unique<MegaChip>();
+        chip8.megachip = megachip.get();
+        if (!megachip->load_rom(chip8, rom->data.data(), rom->data.size())) {
+            std::cerr << rom->name << " is too large to fit in MegaChip memory" << std::endl;
+            return 1;
+        }
+    } else if (!chip8.load_rom(rom->data.data(), rom->data.size())) {
+        std::cerr << rom->name << " is too large to fit in memory" << std::endl;
+        return 1;
+    }
+#endif
     /// End Load game
 
-    // Load font
-    std::uint8_t font[80] = { 0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-                            0x20, 0x60, 0x20, 0x20, 0x70, // 1
-                            0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-                            0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-                            0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-                            0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-                            0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-                            0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-                            0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-                            0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-                            0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-                            0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-                            0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-                            0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-                            0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-                            0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-
-    for (int i = 0; i < 80; i++) {
-        memory[i + 0x050] = font[i];
+    // the debugger, tracer and profiler each drive run_frame() with their own
+    // hooks, a frame only runs with one of them
+    if (!profile_path.empty() && (DEBUG || !trace_path.empty())) {
+        std::cerr << "--profile can't be used with --debug, --gdb or --trace" << std::endl;
+        return 1;
     }
-
-    bool screen[64][32];
-    for (int i = 0; i < 64; i++) {
-        for (int k = 0; k < 32; k++) {
-            screen[i][k] = 0;
-        }
+    if (!trace_path.empty() && DEBUG) {
+        std::cerr << "--trace can't be used with --debug or --gdb" << std::endl;
+        return 1;
     }
 
-    init_SDL2();
+    // they follow run_frame()'s instruction hooks, which neither MegaChip nor
+    // VIP timing frames call
+    if ((DEBUG || !trace_path.empty() || !profile_path.empty()) && (vip_timing || chip8.megachip != nullptr)) {
+        std::cerr << "--debug, --gdb, --trace and --profile can't be used with --vip-timing or MegaChip roms" << std::endl;
+        return 1;
+    }
 
-    while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(1/700));
+    GdbStub gdb;
+    if (gdb_port != 0) {
+        if (!gdb.listen(gdb_port)) {
+            std::cerr << gdb.error() << std::endl;
+            return 1;
+        }
+        gdb_stub = &gdb;
+        std::cout << "waiting for gdb on 127.0.0.1:" << gdb_port << std::endl;
+    }
 
-        if (SDL_PollEvent(&event) && event.type == SDL_QUIT)
-            break;
+    TraceRecorder trace;
+    if (!trace_path.empty()) {
+        if (!trace.open(trace_path, chip8)) {
+            std::cerr << trace.error() << std::endl;
+            return 1;
+        }
+        trace_recorder = &trace;
+    }
 
-        std::uint8_t byte_one = memory[PC];
-        std::uint8_t byte_two = memory[PC + 1];
+    std::unique_ptr<Profiler> guest_profiler;
+    if (!profile_path.empty()) {
+        guest_profiler = std::make_unique<Profiler>();
+        profiler = guest_profiler.get();
+    }
 
-        PC += 2;
+    init_SDL2();
+    SDL_AudioDeviceID audio_device = init_audio();
+    // keep at most one 60hz frame of samples queued so the beep never lags the picture
+    Beeper beeper(audio_ring, sample_rate, sample_rate / 60);
+
+    SDL_DisplayMode display_mode;
+    int refresh_rate = 60;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &display_mode) == 0 && display_mode.refresh_rate > 0) {
+        refresh_rate = display_mode.refresh_rate;
+    }
 
-        if (DEBUG) {
-            bool quit = false;
-            while (!quit)
-            {
-                if (SDL_WaitEvent(&event)) {
-                    switch (event.type) {
-                        case SDL_QUIT:
-                            goto finish;
-                        case SDL_KEYUP:
-                            quit = true;
-                            break;
-                    }
-                }
+    if (DEBUG) {
+        // blocks in getline until the next command, so it is left running at exit
+        std::thread([] {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                std::lock_guard<std::mutex> lock(debug_mutex);
+                debug_commands.push_back(line);
             }
-            std::cout << "index register " << index_register << "\n";
-            std::cout << "opcode 0x" << std::uppercase << std::hex << nibble_1(byte_one) << nibble_2(byte_one) << nibble_1(byte_two) << nibble_2(byte_two) << "\n";
-        }
+        }).detach();
+    }
 
-        // Decode
-        std::uint8_t    X = nibble_2(byte_one);
-        std::uint8_t    Y = nibble_1(byte_two);
-        std::uint8_t    N = nibble_2(byte_two);
-        std::uint8_t   NN = byte_two;
-        std::uint16_t NNN = (X << 8) + byte_two;
-
-        switch (nibble_1(byte_one)) {
-            case 0x00: {
-                if (byte_two == 0xE0) {
-                    // turn all pixels to 0
-
-                    memset(screen, 0, sizeof(screen[0][0]) * 64 * 32);
-                    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-                    SDL_RenderClear(renderer);
-                    SDL_RenderPresent(renderer);
-                } else if (byte_two == 0xEE) {
-                    std::uint16_t saved_PC = stack.back();
-                    stack.pop_back();
-                    PC = saved_PC;
-                }
-                break;
-            } case 0x01: {
-                PC = NNN;
-                break;
-            } case 0x02: {
-                stack.emplace_back(PC);
-                PC = NNN;
-                break;
-            } case 0x03: {
-                if (gpv_registers[X] == byte_two) PC += 2;
-                break;
-            } case 0x04: {
-                if (gpv_registers[X] != byte_two) PC += 2;
-                break;
-            } case 0x05: {
-                if (gpv_registers[X] == gpv_registers[Y]) PC += 2;
-                break;
-            } case 0x06: {
-                gpv_registers[X] = byte_two;
-                break;
-            } case 0x07: {
-                // todo:: read doc later may have done this one wrong
-                gpv_registers[X] += byte_two;
-                break;
-            } case 0x08: {
-                switch (nibble_2(byte_two)) {
-                    case 0x00: {
-                        gpv_registers[X] = gpv_registers[Y];
-                        break;
-                    } case 0x01: {
-                        gpv_registers[X] = gpv_registers[X] | gpv_registers[Y];
-                        break;
-                    } case 0x02: {
-                        gpv_registers[X] = gpv_registers[X] & gpv_registers[Y];
-                        break;
-                    } case 0x03: {
-                        gpv_registers[X] = gpv_registers[X] ^ gpv_registers[Y];
-                        break;
-                    } case 0x04: {
-                        if ((int)gpv_registers[X] + (int)gpv_registers[Y] > 255) gpv_registers[0xF] = 1;
-                        else gpv_registers[0xF] = 0;
-                        gpv_registers[X] = gpv_registers[X] + gpv_registers[Y];
-                        break;
-                    } case 0x05: {
-                        if (gpv_registers[X] > gpv_registers[Y]) gpv_registers[0xF] = 1;
-                        else gpv_registers[0xF] = 0;
-                        gpv_registers[X] = gpv_registers[X] - gpv_registers[Y];
-                        break;
-                    } case 0x06: {
-                        if (!CHIP48_MODE) {
-                            gpv_registers[X] = gpv_registers[Y];
-                        }
-                        if (get_bit(gpv_registers[X], 7) == 1) gpv_registers[0xF] = 1;
-                        else gpv_registers[0xF] = 0;
-                        gpv_registers[X] = gpv_registers[X] >> 1;
-                        break;
-                    } case 0x07: {
-                        if (gpv_registers[Y] > gpv_registers[X]) gpv_registers[0xF] = 1;
-                        else gpv_registers[0xF] = 0;
-                        gpv_registers[X] = gpv_registers[Y] - gpv_registers[X];
-                        break;
-                    } case 0x0E: {
-                        if (!CHIP48_MODE) {
-                            gpv_registers[X] = gpv_registers[Y];
-                        }
-                        if (get_bit(gpv_registers[X], 0) == 1) gpv_registers[0xF] = 1;
-                        else gpv_registers[0xF] = 0;
-                        gpv_registers[X] = gpv_registers[X] << 1;
-                        break;
-                    }
-                }
-                break;
-            } case 0x09: {
-                if (gpv_registers[X] != gpv_registers[Y]) PC += 2;
-                break;
-            } case 0x0A: {
-                index_register = NNN;
-                break;
-            } case 0x0B: {
-                if (!CHIP48_MODE) {
-                    NNN = NNN + gpv_registers[0x0];
-                    PC = NNN;
-                } else {
-                    std::uint16_t XNN = NN + gpv_registers[X];
-                    PC = XNN;
-                }
-                break;
-            } case 0x0C: {
-                std::uint8_t random_number = rand() % UINT8_MAX;
-                gpv_registers[X] = random_number & byte_two;
-                break;
-            } case 0x0D: {
-                std::uint8_t x = gpv_registers[X];
-                std::uint8_t y = gpv_registers[Y];
-                gpv_registers[0x0F] = 0;
-
-                for (int i = 0; i < N; i++) {
-                    std::uint8_t byte = memory[index_register + i];
-                    for (int k = 0; k < 8; k++) {
-                        std::uint8_t bit = get_bit(byte, k);
-                        if (bit != 0) {
-                            if (screen[(x + k)][y + i] == 1) {
-                                gpv_registers[0x0F] = 1;
-                            }
-                            screen[(x + k)][y + i] ^= 1;
-                        }
-                    }
-                }
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, [](int) { stats_requested = 1; });
+#endif
 
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-                SDL_RenderClear(renderer);
-                SDL_SetRenderDrawColor(renderer, 0, 255, 255, 255);
-                for (int i = 0; i < 64; i++) {
-                    for (int k = 0; k < 32; k++) {
-                        if (screen[i][k] == 1) {
-                            SDL_RenderDrawPoint(renderer, i, k);
-                        }
-                    }
-                }
-                SDL_RenderPresent(renderer);
+    PerfOverlay overlay;
+    if (show_overlay) overlay.toggle();
 
-                break;
-            } case 0x0E: {
-                switch (byte_two) {
-                    case 0x9E: {
-                        const std::uint8_t *key_states = SDL_GetKeyboardState(nullptr);
-                        if (key_states[SDL_SCANCODE_1] && gpv_registers[X] == 0x1) PC += 2;
-                        if (key_states[SDL_SCANCODE_2] && gpv_registers[X] == 0x2) PC += 2;
-                        if (key_states[SDL_SCANCODE_3] && gpv_registers[X] == 0x3) PC += 2;
-                        if (key_states[SDL_SCANCODE_4] && gpv_registers[X] == 0xC) PC += 2;
-
-                        if (key_states[SDL_SCANCODE_Q] && gpv_registers[X] == 0x4) PC += 2;
-                        if (key_states[SDL_SCANCODE_W] && gpv_registers[X] == 0x5) PC += 2;
-                        if (key_states[SDL_SCANCODE_E] && gpv_registers[X] == 0x6) PC += 2;
-                        if (key_states[SDL_SCANCODE_R] && gpv_registers[X] == 0xD) PC += 2;
-
-                        if (key_states[SDL_SCANCODE_A] && gpv_registers[X] == 0x7) PC += 2;
-                        if (key_states[SDL_SCANCODE_S] && gpv_registers[X] == 0x8) PC += 2;
-                        if (key_states[SDL_SCANCODE_D] && gpv_registers[X] == 0x9) PC += 2;
-                        if (key_states[SDL_SCANCODE_F] && gpv_registers[X] == 0xE) PC += 2;
-
-                        if (key_states[SDL_SCANCODE_Z] && gpv_registers[X] == 0xA) PC += 2;
-                        if (key_states[SDL_SCANCODE_X] && gpv_registers[X] == 0x0) PC += 2;
-                        if (key_states[SDL_SCANCODE_C] && gpv_registers[X] == 0xB) PC += 2;
-                        if (key_states[SDL_SCANCODE_V] && gpv_registers[X] == 0xF) PC += 2;
-                        break;
-                    } case 0xA1: {
-                        const std::uint8_t *key_states = SDL_GetKeyboardState(nullptr);
-                        if (!key_states[SDL_SCANCODE_1] && gpv_registers[X] == 0x1) PC += 2;
-                        if (!key_states[SDL_SCANCODE_2] && gpv_registers[X] == 0x2) PC += 2;
-                        if (!key_states[SDL_SCANCODE_3] && gpv_registers[X] == 0x3) PC += 2;
-                        if (!key_states[SDL_SCANCODE_4] && gpv_registers[X] == 0xC) PC += 2;
-
-                        if (!key_states[SDL_SCANCODE_Q] && gpv_registers[X] == 0x4) PC += 2;
-                        if (!key_states[SDL_SCANCODE_W] && gpv_registers[X] == 0x5) PC += 2;
-                        if (!key_states[SDL_SCANCODE_E] && gpv_registers[X] == 0x6) PC += 2;
-                        if (!key_states[SDL_SCANCODE_R] && gpv_registers[X] == 0xD) PC += 2;
-
-                        if (!key_states[SDL_SCANCODE_A] && gpv_registers[X] == 0x7) PC += 2;
-                        if (!key_states[SDL_SCANCODE_S] && gpv_registers[X] == 0x8) PC += 2;
-                        if (!key_states[SDL_SCANCODE_D] && gpv_registers[X] == 0x9) PC += 2;
-                        if (!key_states[SDL_SCANCODE_F] && gpv_registers[X] == 0xE) PC += 2;
-
-                        if (!key_states[SDL_SCANCODE_Z] && gpv_registers[X] == 0xA) PC += 2;
-                        if (!key_states[SDL_SCANCODE_X] && gpv_registers[X] == 0x0) PC += 2;
-                        if (!key_states[SDL_SCANCODE_C] && gpv_registers[X] == 0xB) PC += 2;
-                        if (!key_states[SDL_SCANCODE_V] && gpv_registers[X] == 0xF) PC += 2;
-                        break;
-                    }
-                }
-                break;
-            } case 0x0F: {
-                switch (byte_two) {
-                    case 0x07: {
-                        gpv_registers[X] = delay_timer;
-                        break;
-                    } case 0x15: {
-                        delay_timer = gpv_registers[X];
-                        break;
-                    } case 0x18: {
-                        sound_timer = gpv_registers[X];
-                        break;
-                    } case 0x1E: {
-                        index_register += gpv_registers[X];
-                        break;
-                    } case 0x0A: {
-                        while (true) {
-                            const std::uint8_t *key_states = SDL_GetKeyboardState(nullptr);
-                            if (key_states[SDL_SCANCODE_1]) {gpv_registers[X] = 0x1; break;}
-                            if (key_states[SDL_SCANCODE_2]) {gpv_registers[X] = 0x2; break;}
-                            if (key_states[SDL_SCANCODE_3]) {gpv_registers[X] = 0x3; break;}
-                            if (key_states[SDL_SCANCODE_4]) {gpv_registers[X] = 0xC; break;}
-
-                            if (key_states[SDL_SCANCODE_Q]) {gpv_registers[X] = 0x4; break;}
-                            if (key_states[SDL_SCANCODE_W]) {gpv_registers[X] = 0x5; break;}
-                            if (key_states[SDL_SCANCODE_E]) {gpv_registers[X] = 0x6; break;}
-                            if (key_states[SDL_SCANCODE_R]) {gpv_registers[X] = 0xD; break;}
-
-                            if (key_states[SDL_SCANCODE_A]) {gpv_registers[X] = 0x7; break;}
-                            if (key_states[SDL_SCANCODE_S]) {gpv_registers[X] = 0x8; break;}
-                            if (key_states[SDL_SCANCODE_D]) {gpv_registers[X] = 0x9; break;}
-                            if (key_states[SDL_SCANCODE_F]) {gpv_registers[X] = 0xE; break;}
-
-                            if (key_states[SDL_SCANCODE_Z]) {gpv_registers[X] = 0xA; break;}
-                            if (key_states[SDL_SCANCODE_X]) {gpv_registers[X] = 0x0; break;}
-                            if (key_states[SDL_SCANCODE_C]) {gpv_registers[X] = 0xB; break;}
-                            if (key_states[SDL_SCANCODE_V]) {gpv_registers[X] = 0xF; break;}
-                        }
-                        break;
-                    } case 0x29: {
-                        index_register = 0x050 + gpv_registers[X] * 5;
-                        break;
-                    } case 0x33: {
-                        uint8_t number = gpv_registers[X];
-                        std::vector<std::uint8_t> numbers(0, 0);
-                        collect_digits(numbers, number);
+    std::thread emulation_thread(emulation_loop, std::ref(chip8), std::ref(beeper), audio_device != 0, refresh_rate);
 
-                        for (int i = 0; i < numbers.size(); i++) {
-                            memory[index_register + i] = numbers[i];
-                        }
+    // this thread only handles input and presentation, so waiting on vsync never stalls the interpreter
+    zones_name_thread("main");
+    while (running) {
+        {
+            CHIP8_ZONE("event pump");
+            while (SDL_PollEvent(&event)) {
+                switch (event.type) {
+                    case SDL_QUIT:
+                        running = false;
                         break;
-                    } case 0x55: {
-                        for (int i = 0; i <= X; i++) {
-                            memory[index_register + i] = gpv_registers[i];
+                    case SDL_KEYDOWN:
+                        if (event.key.keysym.scancode == SDL_SCANCODE_TAB && !event.key.repeat) {
+                            turbo = !turbo;
+                            SDL_SetWindowTitle(window, turbo ? "Kolby's Chip-8 Emulator (turbo)" : "Kolby's Chip-8 Emulator");
+                        } else if (event.key.keysym.scancode == SDL_SCANCODE_F1 && !event.key.repeat) {
+                            overlay.toggle();
                         }
                         break;
-                    } case 0x65: {
-                        for (int i = 0; i <= X; i++) {
-                            gpv_registers[i] = memory[index_register + i];
-                        }
+                    case SDL_KEYUP:
+                        if (DEBUG) debug_key_step.store(true, std::memory_order_relaxed);
                         break;
-                    }
                 }
-                break;
+            }
+
+            const std::uint8_t *key_states = SDL_GetKeyboardState(nullptr);
+            std::uint16_t keys = 0;
+            for (int key = 0; key < 16; key++) {
+                if (key_states[keymap[key]]) keys |= 1 << key;
+            }
+            if (keys != key_mask.load(std::memory_order_relaxed)) {
+                key_changed_at.store(timestamp(), std::memory_order_relaxed);
+                key_mask.store(keys, std::memory_order_release);
             }
         }
 
-        // decrement timers
-        if (delay_timer > 0) {
-            delay_timer -= 1;
+        if (stats_requested) {
+            stats_requested = 0;
+            runtime_stats.update();
+            std::cout << format_stats(runtime_stats.front()) << std::flush;
+            print_latencies();
         }
-        if (sound_timer > 0) {
-            // This is the beep, but honestly I find it annoying on windows where it just plays the error sound now
-            //std::cout << '\a';
-            sound_timer -= 1;
+
+        // a refresh of the overlay's numbers redraws the last frame under them
+        auto now = PerfOverlay::clock::now();
+        bool fresh = frames.update();
+        bool overlay_changed = false;
+        if (overlay.visible()) {
+            runtime_stats.update();
+            overlay_changed = overlay.update(runtime_stats.front(), now);
         }
+        if (fresh || overlay_changed) {
+            const Frame &frame = frames.front();
+            {
+                CHIP8_ZONE("framebuffer upload");
+                if (frame.megachip) draw_megachip_screen(frame.pixels);
+                else draw_screen(frame.screen);
+                overlay.draw(renderer);
+            }
+            {
+                // blocks on vsync
+                CHIP8_ZONE("present");
+                SDL_RenderPresent(renderer);
+            }
+            if (fresh) {
+                overlay.presented(PerfOverlay::clock::now());
+                std::int64_t presented_at = timestamp();
+                present_latency.record(presented_at - frame.published_at);
+                if (frame.input_at != 0) input_latency.record(presented_at - frame.input_at);
+            }
+        } else {
+            SDL_Delay(1);
+        }
+    }
 
+    emulation_thread.join();
+    if (trace_recorder != nullptr) {
+        trace.close();
+        if (!trace.error().empty()) std::cerr << trace.error() << std::endl;
+        std::cout << "traced " << trace.instructions() << " instructions to " << trace_path << std::endl;
+    }
+    if (profiler != nullptr) {
+#ifdef CHIP8_AOT
+        std::string profiled_rom = "aot";
+#else
+        std::string profiled_rom(rom->name);
+#endif
+        if (profiler->write_callgrind(profile_path, profiled_rom)) {
+            std::cout << "profiled " << profiler->instructions() << " instructions into " << profile_path << std::endl;
+        } else {
+            std::cerr << "could not write " << profile_path << std::endl;
+        }
     }
 
-    finish:
+    std::cout << chip8.cycle_count << " cycles run, " << chip8.elided_cycles << " idle cycles skipped" << std::endl;
+    print_latencies();
+
+    if (audio_device != 0) SDL_CloseAudioDevice(audio_device);
+    // every thread that records zones has stopped by now
+    if (!zones_path.empty()) {
+        if (zones_write(zones_path)) std::cout << "wrote the frame pipeline zones to " << zones_path << std::endl;
+        else std::cerr << "could not write " << zones_path << std::endl;
+    }
+    if (megachip_texture != nullptr) SDL_DestroyTexture(megachip_texture);
+    overlay.release();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
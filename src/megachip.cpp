@@ -0,0 +1,356 @@
+#include <algorithm>
+#include "chip8.h"
+#include "megachip.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHIP8_SSE2
+#endif
+
+static const std::uint32_t address_mask = MegaChip::memory_size - 1;
+static const std::uint32_t background = 0xFF000000;
+
+// Blends a row of sprite colours into the back buffer. Each source pixel's
+// alpha, scaled by the blend mode's opacity, mixes the mode's result with
+// what is already there, and transparent pixels leave it untouched.
+static void blend_row(std::uint32_t *dst, const std::uint32_t *src, int count, MegaChip::Blend blend) {
+    int opacity = blend == MegaChip::Blend::Opacity25 ? 64 :
+                  blend == MegaChip::Blend::Opacity50 ? 128 :
+                  blend == MegaChip::Blend::Opacity75 ? 192 : 256;
+    int i = 0;
+
+#ifdef CHIP8_SSE2
+    // four pixels at a time, channels widened to 16 bits
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i scale = _mm_set1_epi16((short)opacity);
+    const __m128i full = _mm_set1_epi16(256);
+    const __m128i opaque = _mm_set1_epi32((int)background);
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+
+        __m128i e_lo = s_lo;
+        __m128i e_hi = s_hi;
+        if (blend == MegaChip::Blend::Add) {
+            __m128i e = _mm_adds_epu8(s, d);
+            e_lo = _mm_unpacklo_epi8(e, zero);
+            e_hi = _mm_unpackhi_epi8(e, zero);
+        } else if (blend == MegaChip::Blend::Multiply) {
+            e_lo = _mm_srli_epi16(_mm_mullo_epi16(s_lo, d_lo), 8);
+            e_hi = _mm_srli_epi16(_mm_mullo_epi16(s_hi, d_hi), 8);
+        }
+
+        // alpha broadcast to every channel of its pixel, then 0 - 256
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+        a_lo = _mm_srli_epi16(_mm_mullo_epi16(a_lo, scale), 8);
+        a_hi = _mm_srli_epi16(_mm_mullo_epi16(a_hi, scale), 8);
+        a_lo = _mm_add_epi16(a_lo, _mm_srli_epi16(a_lo, 7));
+        a_hi = _mm_add_epi16(a_hi, _mm_srli_epi16(a_hi, 7));
+
+        __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(e_lo, a_lo),
+                                                  _mm_mullo_epi16(d_lo, _mm_sub_epi16(full, a_lo))), 8);
+        __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(e_hi, a_hi),
+                                                  _mm_mullo_epi16(d_hi, _mm_sub_epi16(full, a_hi))), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+#endif
+
+    for (; i < count; i++) {
+        std::uint32_t s = src[i];
+        std::uint32_t d = dst[i];
+        int a = (int)((s >> 24) * opacity) >> 8;
+        a += a >> 7;
+
+        std::uint32_t out = background;
+        for (int shift = 0; shift < 24; shift += 8) {
+            int sc = (s >> shift) & 0xFF;
+            int dc = (d >> shift) & 0xFF;
+            int ec = blend == MegaChip::Blend::Add ? std::min(255, sc + dc) :
+                     blend == MegaChip::Blend::Multiply ? (sc * dc) >> 8 : sc;
+            out |= (std::uint32_t)((ec * a + dc * (256 - a)) >> 8) << shift;
+        }
+        dst[i] = out;
+    }
+}
+
+MegaChip::MegaChip() : memory_(memory_size) {
+    reset();
+}
+
+void MegaChip::reset() {
+    std::fill(memory_.begin(), memory_.end(), 0);
+    index_ = 0;
+    enabled_ = false;
+    palette_.fill(0);
+    sprite_width_ = 256;
+    sprite_height_ = 256;
+    screen_alpha_ = 255;
+    blend_ = Blend::Normal;
+    collision_index_ = 0;
+    pixels_.fill(background);
+    indices_.fill(0);
+    frame_.fill(background);
+    sound_playing_ = false;
+}
+
+bool MegaChip::load_rom(Chip8 &chip8, const std::uint8_t *data, std::size_t size) {
+    if (size > memory_.size() - 0x200) return false;
+    reset();
+    std::copy(chip8.memory.begin(), chip8.memory.end(), memory_.begin());
+    std::copy(data, data + size, memory_.begin() + 0x200);
+    // keep Chip8::memory showing the code for anything that inspects it
+    std::copy(memory_.begin(), memory_.begin() + chip8.memory.size(), chip8.memory.begin());
+    return true;
+}
+
+void MegaChip::write(std::uint32_t address, std::uint8_t value, Chip8 &chip8) {
+    address &= address_mask;
+    memory_[address] = value;
+    if (address < chip8.memory.size()) chip8.memory[address] = value;
+}
+
+void MegaChip::step(Chip8 &chip8) {
+    std::uint16_t pc = chip8.PC;
+    std::uint8_t byte_one = memory_[pc];
+    std::uint8_t byte_two = memory_[pc + 1];
+    std::uint16_t opcode = (byte_one << 8) | byte_two;
+    chip8.PC += 2;
+    chip8.stats.opcodes[byte_one >> 4]++;
+
+    std::uint8_t X = byte_one & 0xF;
+    std::uint8_t Y = byte_two >> 4;
+    std::uint8_t N = byte_two & 0xF;
+    std::array<std::uint8_t, 16> &V = chip8.gpv_registers;
+
+    switch (byte_one) {
+        case 0x00:
+            if (byte_two == 0x10) {
+                enabled_ = false;
+            } else if (byte_two == 0x11) {
+                enabled_ = true;
+                pixels_.fill(background);
+                indices_.fill(0);
+            } else if (byte_two == 0xE0) {
+                if (enabled_) present(chip8);
+                else chip8.clear_screen();
+            } else if (enabled_ && byte_two == 0xFB) {
+                scroll(4, 0);
+            } else if (enabled_ && byte_two == 0xFC) {
+                scroll(-4, 0);
+            } else if (enabled_ && (byte_two & 0xF0) == 0xB0) {
+                scroll(0, -N);
+            } else if (enabled_ && (byte_two & 0xF0) == 0xC0) {
+                scroll(0, N);
+            } else {
+                chip8.execute(opcode);
+            }
+            break;
+        case 0x01:
+            // 01NN NNNN, the only four byte instruction
+            index_ = (byte_two << 16) | (memory_[pc + 2] << 8) | memory_[pc + 3];
+            chip8.PC += 2;
+            break;
+        case 0x02:
+            for (int i = 0; i < byte_two && i < 255; i++) {
+                std::uint32_t address = index_ + i * 4;
+                palette_[i + 1] = (memory_[address & address_mask] << 24) | (memory_[(address + 1) & address_mask] << 16) |
+                                  (memory_[(address + 2) & address_mask] << 8) | memory_[(address + 3) & address_mask];
+            }
+            break;
+        case 0x03:
+            sprite_width_ = byte_two == 0 ? 256 : byte_two;
+            break;
+        case 0x04:
+            sprite_height_ = byte_two == 0 ? 256 : byte_two;
+            break;
+        case 0x05:
+            screen_alpha_ = byte_two;
+            break;
+        case 0x06:
+            // rate (16 bit), length (24 bit) and a reserved byte, then the samples
+            sound_rate_ = (memory_[index_ & address_mask] << 8) | memory_[(index_ + 1) & address_mask];
+            sound_length_ = (memory_[(index_ + 2) & address_mask] << 16) | (memory_[(index_ + 3) & address_mask] << 8) |
+                            memory_[(index_ + 4) & address_mask];
+            sound_start_ = index_ + 6;
+            sound_loop_ = N == 0;
+            sound_position_ = 0;
+            sound_playing_ = sound_rate_ != 0 && sound_length_ != 0;
+            break;
+        case 0x07:
+            sound_playing_ = false;
+            break;
+        case 0x08:
+            blend_ = N <= 5 ? (Blend)N : Blend::Normal;
+            break;
+        case 0x09:
+            collision_index_ = byte_two;
+            break;
+        default:
+            switch (byte_one >> 4) {
+                case 0xA:
+                    index_ = opcode & 0xFFF;
+                    break;
+                case 0xD:
+                    if (enabled_) draw_sprite(chip8, X, Y);
+                    else draw_chip8_sprite(chip8, X, Y, N);
+                    chip8.stats.draws++;
+                    chip8.stats.collisions += chip8.gpv_registers[0xF];
+                    break;
+                case 0xF:
+                    switch (byte_two) {
+                        case 0x02:
+                            for (int i = 0; i < 16; i++) {
+                                chip8.audio_pattern[i] = memory_[(index_ + i) & address_mask];
+                            }
+                            break;
+                        case 0x1E:
+                            index_ = (index_ + V[X]) & address_mask;
+                            break;
+                        case 0x29:
+                            index_ = 0x050 + V[X] * 5;
+                            break;
+                        case 0x33:
+                            for (int i = 0; i < 3; i++) {
+                                write(index_ + i, bcd_table[V[X]][i], chip8);
+                            }
+                            break;
+                        case 0x55:
+                            for (int i = 0; i <= X; i++) {
+                                write(index_ + i, V[i], chip8);
+                            }
+                            break;
+                        case 0x65:
+                            for (int i = 0; i <= X; i++) {
+                                V[i] = memory_[(index_ + i) & address_mask];
+                            }
+                            break;
+                        default:
+                            chip8.execute(opcode);
+                            break;
+                    }
+                    break;
+                default:
+                    chip8.execute(opcode);
+                    break;
+            }
+            break;
+    }
+    chip8.index_register = (std::uint16_t)index_;
+}
+
+void MegaChip::run_frame(Chip8 &chip8, int instructions) {
+    for (int i = 0; i < instructions; i++) {
+        step(chip8);
+    }
+    chip8.cycle_count += instructions;
+    chip8.tick_timers();
+}
+
+void MegaChip::draw_chip8_sprite(Chip8 &chip8, std::uint8_t X, std::uint8_t Y, std::uint8_t N) {
+    std::uint8_t x = chip8.gpv_registers[X] % 64;
+    std::uint8_t y = chip8.gpv_registers[Y] % 32;
+    chip8.gpv_registers[0xF] = 0;
+
+    for (int i = 0; i < N && y + i < 32; i++) {
+        std::uint8_t byte = memory_[(index_ + i) & address_mask];
+        for (int k = 0; k < 8 && x + k < 64; k++) {
+            if (get_bit(byte, k)) {
+                if (chip8.screen[x + k][y + i]) chip8.gpv_registers[0xF] = 1;
+                chip8.screen[x + k][y + i] ^= 1;
+            }
+        }
+    }
+    chip8.draw_flag = true;
+}
+
+void MegaChip::draw_sprite(Chip8 &chip8, std::uint8_t X, std::uint8_t Y) {
+    // sprites are one palette index per pixel, clipped at the right and bottom edges
+    int x = chip8.gpv_registers[X];
+    int y = chip8.gpv_registers[Y];
+    int count = std::min(sprite_width_, width - x);
+    chip8.gpv_registers[0xF] = 0;
+    if (count <= 0) return;
+
+    std::uint32_t colours[width];
+    for (int row = 0; row < sprite_height_ && y + row < height; row++) {
+        std::uint32_t source = index_ + row * sprite_width_;
+        std::uint8_t *indices = &indices_[(y + row) * width + x];
+        for (int k = 0; k < count; k++) {
+            std::uint8_t index = memory_[(source + k) & address_mask];
+            colours[k] = palette_[index];
+            if (index != 0) {
+                if (indices[k] != 0 && indices[k] == collision_index_) chip8.gpv_registers[0xF] = 1;
+                indices[k] = index;
+            }
+        }
+        blend_row(&pixels_[(y + row) * width + x], colours, count, blend_);
+    }
+}
+
+void MegaChip::present(Chip8 &chip8) {
+    if (screen_alpha_ == 255) {
+        frame_ = pixels_;
+    } else {
+        for (int i = 0; i < width * height; i++) {
+            std::uint32_t pixel = pixels_[i];
+            std::uint32_t out = background;
+            for (int shift = 0; shift < 24; shift += 8) {
+                out |= (((pixel >> shift) & 0xFF) * screen_alpha_ / 255) << shift;
+            }
+            frame_[i] = out;
+        }
+    }
+    pixels_.fill(background);
+    indices_.fill(0);
+    chip8.draw_flag = true;
+}
+
+void MegaChip::scroll(int dx, int dy) {
+    // rows move by dy and then each row by dx, uncovered pixels are cleared
+    auto shift = [&](auto &buffer, auto empty) {
+        if (dy > 0) {
+            std::copy_backward(buffer.begin(), buffer.end() - dy * width, buffer.end());
+            std::fill(buffer.begin(), buffer.begin() + dy * width, empty);
+        } else if (dy < 0) {
+            std::copy(buffer.begin() - dy * width, buffer.end(), buffer.begin());
+            std::fill(buffer.end() + dy * width, buffer.end(), empty);
+        }
+        for (int row = 0; dx != 0 && row < height; row++) {
+            auto begin = buffer.begin() + row * width;
+            if (dx > 0) {
+                std::copy_backward(begin, begin + width - dx, begin + width);
+                std::fill(begin, begin + dx, empty);
+            } else {
+                std::copy(begin - dx, begin + width, begin);
+                std::fill(begin + width + dx, begin + width, empty);
+            }
+        }
+    };
+    shift(pixels_, background);
+    shift(indices_, (std::uint8_t)0);
+}
+
+bool MegaChip::render_sound(std::int16_t *out, std::size_t count, int sample_rate) {
+    if (!sound_playing_) return false;
+
+    double step = (double)sound_rate_ / sample_rate;
+    for (std::size_t i = 0; i < count; i++) {
+        if (!sound_playing_) {
+            out[i] = 0;
+            continue;
+        }
+        std::uint32_t sample = (std::uint32_t)sound_position_;
+        out[i] = (std::int16_t)((memory_[(sound_start_ + sample) & address_mask] - 128) * 32);
+        sound_position_ += step;
+        if (sound_position_ >= sound_length_) {
+            if (sound_loop_) sound_position_ -= sound_length_;
+            else sound_playing_ = false;
+        }
+    }
+    return true;
+}
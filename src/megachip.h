@@ -0,0 +1,80 @@
+#ifndef CHIP8_EMULATOR_MEGACHIP_H
+#define CHIP8_EMULATOR_MEGACHIP_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Chip8;
+
+// MegaChip8 extension. Attached to a Chip8 through Chip8::megachip, it runs
+// every instruction against its own 16Mb memory, with a 24 bit I register
+// (01NN NNNN), so roms of any size load. Until the rom enables MegaChip mode
+// with 0011 the machine behaves like a chip8 drawing to Chip8::screen; after
+// that sprites are palette indexed and alpha blended into a 256x192 ARGB back
+// buffer, which 00E0 presents and clears. Code still has to live in the
+// first 4Kb, jumps and calls are 12 bit.
+class MegaChip {
+public:
+    static constexpr int width = 256;
+    static constexpr int height = 192;
+    static constexpr std::size_t memory_size = 16 * 1024 * 1024;
+
+    // sprite blending selected with 080N
+    enum class Blend : std::uint8_t {
+        Normal, Opacity25, Opacity50, Opacity75, Add, Multiply
+    };
+
+    // allocates the whole address space up front
+    MegaChip();
+
+    void reset();
+    // chip8 must have been reset(), its font is copied into the large memory
+    bool load_rom(Chip8 &chip8, const std::uint8_t *data, std::size_t size);
+
+    void step(Chip8 &chip8);
+    void run_frame(Chip8 &chip8, int instructions);
+
+    // true between 0011 and 0010
+    bool enabled() const { return enabled_; }
+
+    // the last presented frame, 0xAARRGGBB with screen alpha applied
+    const std::array<std::uint32_t, width * height> &frame() const { return frame_; }
+
+    // Mixes the digitized sound started by 060N into `count` samples at
+    // `sample_rate`, returns false when none is playing.
+    bool render_sound(std::int16_t *out, std::size_t count, int sample_rate);
+
+private:
+    void draw_sprite(Chip8 &chip8, std::uint8_t X, std::uint8_t Y);
+    void draw_chip8_sprite(Chip8 &chip8, std::uint8_t X, std::uint8_t Y, std::uint8_t N);
+    void present(Chip8 &chip8);
+    void scroll(int dx, int dy);
+    void write(std::uint32_t address, std::uint8_t value, Chip8 &chip8);
+
+    std::vector<std::uint8_t> memory_;
+    std::uint32_t index_ = 0;
+    bool enabled_ = false;
+
+    // palette index 0 is always transparent
+    std::array<std::uint32_t, 256> palette_{};
+    int sprite_width_ = 256;
+    int sprite_height_ = 256;
+    std::uint8_t screen_alpha_ = 255;
+    Blend blend_ = Blend::Normal;
+    std::uint8_t collision_index_ = 0;
+
+    // back buffer, and the palette index last drawn at each pixel for collisions
+    std::array<std::uint32_t, width * height> pixels_{};
+    std::array<std::uint8_t, width * height> indices_{};
+    std::array<std::uint32_t, width * height> frame_{};
+
+    // digitized sound, 8 bit unsigned samples at memory_[sound_start_]
+    bool sound_playing_ = false;
+    bool sound_loop_ = false;
+    std::uint32_t sound_start_ = 0;
+    std::uint32_t sound_length_ = 0;
+    std::uint32_t sound_rate_ = 0;
+    double sound_position_ = 0;
+};
+#endif //CHIP8_EMULATOR_MEGACHIP_H
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstdio>
+#include "overlay.h"
+
+namespace {
+
+// rows top to bottom, three bits each with the leftmost pixel highest
+constexpr std::uint16_t glyph(int r0, int r1, int r2, int r3, int r4) {
+    return (std::uint16_t)(r0 << 12 | r1 << 9 | r2 << 6 | r3 << 3 | r4);
+}
+
+// only the characters the overlay prints, anything else is blank
+std::uint16_t font(char c) {
+    switch (c) {
+        case '0': return glyph(0b111, 0b101, 0b101, 0b101, 0b111);
+        case '1': return glyph(0b010, 0b110, 0b010, 0b010, 0b111);
+        case '2': return glyph(0b111, 0b001, 0b111, 0b100, 0b111);
+        case '3': return glyph(0b111, 0b001, 0b111, 0b001, 0b111);
+        case '4': return glyph(0b101, 0b101, 0b111, 0b001, 0b001);
+        case '5': return glyph(0b111, 0b100, 0b111, 0b001, 0b111);
+        case '6': return glyph(0b111, 0b100, 0b111, 0b101, 0b111);
+        case '7': return glyph(0b111, 0b001, 0b001, 0b001, 0b001);
+        case '8': return glyph(0b111, 0b101, 0b111, 0b101, 0b111);
+        case '9': return glyph(0b111, 0b101, 0b111, 0b001, 0b111);
+        case 'A': return glyph(0b010, 0b101, 0b111, 0b101, 0b101);
+        case 'C': return glyph(0b011, 0b100, 0b100, 0b100, 0b011);
+        case 'E': return glyph(0b111, 0b100, 0b110, 0b100, 0b111);
+        case 'F': return glyph(0b111, 0b100, 0b110, 0b100, 0b100);
+        case 'I': return glyph(0b111, 0b010, 0b010, 0b010, 0b111);
+        case 'K': return glyph(0b101, 0b101, 0b110, 0b101, 0b101);
+        case 'L': return glyph(0b100, 0b100, 0b100, 0b100, 0b111);
+        case 'M': return glyph(0b101, 0b111, 0b111, 0b101, 0b101);
+        case 'O': return glyph(0b010, 0b101, 0b101, 0b101, 0b010);
+        case 'P': return glyph(0b110, 0b101, 0b110, 0b100, 0b100);
+        case 'R': return glyph(0b110, 0b101, 0b110, 0b101, 0b101);
+        case 'S': return glyph(0b011, 0b100, 0b010, 0b001, 0b110);
+        case 'U': return glyph(0b101, 0b101, 0b101, 0b101, 0b111);
+        case 'V': return glyph(0b101, 0b101, 0b101, 0b101, 0b010);
+        case 'Y': return glyph(0b101, 0b101, 0b010, 0b010, 0b010);
+        case '%': return glyph(0b101, 0b001, 0b010, 0b100, 0b101);
+        case '.': return glyph(0b000, 0b000, 0b000, 0b000, 0b010);
+        default: return 0;
+    }
+}
+
+const std::uint32_t background = 0xA0000000;
+const std::uint32_t foreground = 0xFFFFFFFF;
+
+}
+
+void PerfOverlay::release() {
+    if (texture_ != nullptr) SDL_DestroyTexture(texture_);
+    texture_ = nullptr;
+}
+
+void PerfOverlay::toggle() {
+    visible_ = !visible_;
+    // rates start over from the next update()
+    last_update_ = {};
+    last_present_ = {};
+    interval_filled_ = 0;
+}
+
+void PerfOverlay::presented(clock::time_point now) {
+    if (!visible_) return;
+    if (last_present_ != clock::time_point{}) {
+        intervals_[interval_next_] = std::chrono::duration<float, std::milli>(now - last_present_).count();
+        interval_next_ = (interval_next_ + 1) % interval_count;
+        interval_filled_ = std::min(interval_filled_ + 1, interval_count);
+    }
+    last_present_ = now;
+    presents_++;
+}
+
+bool PerfOverlay::update(const RuntimeStats &stats, clock::time_point now) {
+    if (!visible_) return false;
+    std::uint64_t instructions = stats.instructions();
+    if (last_update_ == clock::time_point{} || now - last_update_ < std::chrono::milliseconds(500)) {
+        if (last_update_ == clock::time_point{}) {
+            last_update_ = now;
+            last_cpu_ = std::clock();
+            last_instructions_ = instructions;
+            last_frames_ = stats.frames;
+            last_presents_ = presents_;
+            cost_ = {};
+        }
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(now - last_update_).count();
+    std::clock_t cpu = std::clock();
+    std::uint64_t presents = presents_ - last_presents_;
+
+    float p50 = 0, p99 = 0;
+    if (interval_filled_ > 0) {
+        std::array<float, interval_count> sorted = intervals_;
+        float *end = sorted.data() + interval_filled_;
+        std::nth_element(sorted.data(), sorted.data() + interval_filled_ / 2, end);
+        p50 = sorted[interval_filled_ / 2];
+        std::nth_element(sorted.data(), sorted.data() + interval_filled_ * 99 / 100, end);
+        p99 = sorted[interval_filled_ * 99 / 100];
+    }
+
+    double ips = (instructions - last_instructions_) / seconds;
+    if (ips >= 1e6) snprintf(text_[0], sizeof(text_[0]), "IPS %.2fM", ips / 1e6);
+    else snprintf(text_[0], sizeof(text_[0]), "IPS %.1fK", ips / 1e3);
+    snprintf(text_[1], sizeof(text_[1]), "FPS %.1f EMU %.1f", presents / seconds, (stats.frames - last_frames_) / seconds);
+    snprintf(text_[2], sizeof(text_[2]), "P50 %.1f P99 %.1f MS", p50, p99);
+    // all threads of the process, so more than one core reads above 100%
+    snprintf(text_[3], sizeof(text_[3]), "CPU %.0f%%", 100.0 * (cpu - last_cpu_) / CLOCKS_PER_SEC / seconds);
+    long long cost = std::chrono::duration_cast<std::chrono::microseconds>(cost_).count();
+    snprintf(text_[4], sizeof(text_[4]), "OVERLAY %lldUS", cost / (long long)std::max<std::uint64_t>(presents, 1));
+    render_text();
+
+    last_update_ = now;
+    last_cpu_ = cpu;
+    last_instructions_ = instructions;
+    last_frames_ = stats.frames;
+    last_presents_ = presents_;
+    // this refresh counts towards the next one
+    cost_ = clock::now() - now;
+    return true;
+}
+
+void PerfOverlay::render_text() {
+    pixels_.fill(background);
+    for (int line = 0; line < lines; line++) {
+        for (int column = 0; column < columns && text_[line][column] != '\0'; column++) {
+            std::uint16_t bits = font(text_[line][column]);
+            for (int y = 0; y < 5; y++) {
+                for (int x = 0; x < 3; x++) {
+                    if ((bits >> (14 - y * 3 - x)) & 1) {
+                        pixels_[(1 + line * 6 + y) * texture_width + 1 + column * 4 + x] = foreground;
+                    }
+                }
+            }
+        }
+    }
+    text_changed_ = true;
+}
+
+void PerfOverlay::draw(SDL_Renderer *renderer) {
+    if (!visible_) return;
+    clock::time_point start = clock::now();
+    if (texture_ == nullptr) {
+        texture_ = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                     texture_width, texture_height);
+        if (texture_ == nullptr) return;
+        SDL_SetTextureBlendMode(texture_, SDL_BLENDMODE_BLEND);
+        text_changed_ = true;
+    }
+    if (text_changed_) {
+        SDL_UpdateTexture(texture_, nullptr, pixels_.data(), texture_width * sizeof(std::uint32_t));
+        text_changed_ = false;
+    }
+
+    // in window pixels, whatever logical size the screen was drawn at
+    SDL_RenderSetLogicalSize(renderer, 0, 0);
+    SDL_Rect destination{4, 4, texture_width * 2, texture_height * 2};
+    SDL_RenderCopy(renderer, texture_, nullptr, &destination);
+    cost_ += clock::now() - start;
+}
@@ -0,0 +1,71 @@
+#ifndef CHIP8_EMULATOR_OVERLAY_H
+#define CHIP8_EMULATOR_OVERLAY_H
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <SDL.h>
+#include "stats.h"
+
+// Performance numbers drawn over the top left corner of the window:
+// instructions per second, emulated and presented frames per second, the
+// 50th and 99th percentile time between presented frames, host CPU use and
+// what the overlay itself costs per presented frame. The text is rasterised
+// with a built in 3x5 font into a small streaming texture, only when the
+// numbers are refreshed (twice a second); every other frame just copies the
+// texture.
+class PerfOverlay {
+public:
+    using clock = std::chrono::steady_clock;
+
+    bool visible() const { return visible_; }
+    void toggle();
+
+    // a new frame reached the screen at `now`
+    void presented(clock::time_point now);
+
+    // Takes the counters as of the last emulated frame. Returns true when
+    // the numbers were refreshed and the screen should be drawn again.
+    bool update(const RuntimeStats &stats, clock::time_point now);
+
+    // draws over whatever was rendered, call before SDL_RenderPresent
+    void draw(SDL_Renderer *renderer);
+
+    // frees the texture, before the renderer that created it goes away
+    void release();
+
+private:
+    static constexpr int lines = 5;
+    static constexpr int columns = 21;
+    // 4x6 pixel cells, 1 pixel of margin around the text
+    static constexpr int texture_width = columns * 4 + 1;
+    static constexpr int texture_height = lines * 6 + 1;
+    static constexpr int interval_count = 256;
+
+    void render_text();
+
+    bool visible_ = false;
+    SDL_Texture *texture_ = nullptr;
+    bool text_changed_ = false;
+    // room for "OVERLAY " and any 64 bit count, only the first `columns` are drawn
+    char text_[lines][32]{};
+    std::array<std::uint32_t, texture_width * texture_height> pixels_{};
+
+    // milliseconds between the last presented frames, a ring
+    std::array<float, interval_count> intervals_{};
+    int interval_next_ = 0;
+    int interval_filled_ = 0;
+    clock::time_point last_present_{};
+    std::uint64_t presents_ = 0;
+
+    // the state at the last refresh, rates are taken against it
+    clock::time_point last_update_{};
+    std::clock_t last_cpu_ = 0;
+    std::uint64_t last_instructions_ = 0;
+    std::uint64_t last_frames_ = 0;
+    std::uint64_t last_presents_ = 0;
+
+    // time spent in update() and draw() since the last refresh
+    clock::duration cost_{};
+};
+#endif //CHIP8_EMULATOR_OVERLAY_H
@@ -0,0 +1,24 @@
+#include <algorithm>
+#include <thread>
+#include "pacer.h"
+
+void FramePacer::wait_until(clock::time_point deadline) {
+    const clock::duration min_margin = std::chrono::microseconds(100);
+    const clock::duration max_margin = std::chrono::milliseconds(4);
+
+    auto now = clock::now();
+    if (deadline - now > margin_) {
+        auto wake = deadline - margin_;
+        std::this_thread::sleep_until(wake);
+        now = clock::now();
+
+        // move the margin an eighth of the way towards 1.5x the observed oversleep
+        auto late = now - wake;
+        auto target = late + late / 2;
+        margin_ = std::clamp(margin_ + (target - margin_) / 8, min_margin, max_margin);
+    }
+
+    while (clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
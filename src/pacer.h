@@ -0,0 +1,20 @@
+#ifndef CHIP8_EMULATOR_PACER_H
+#define CHIP8_EMULATOR_PACER_H
+#include <chrono>
+
+// Waits for frame deadlines without burning a core. The OS sleep is asked to
+// wake up a little early and the remainder is spun; how early adapts to how
+// late sleeps actually wake up on this host, so the spin stays as short as
+// the scheduler allows.
+class FramePacer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    void wait_until(clock::time_point deadline);
+
+    clock::duration margin() const { return margin_; }
+
+private:
+    clock::duration margin_ = std::chrono::milliseconds(1);
+};
+#endif //CHIP8_EMULATOR_PACER_H
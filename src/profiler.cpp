@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <vector>
+#include "profiler.h"
+
+namespace {
+
+std::string function_name(std::uint16_t entry) {
+    char name[16];
+    if (entry == 0x200) snprintf(name, sizeof(name), "main");
+    else snprintf(name, sizeof(name), "sub_%03X", entry);
+    return name;
+}
+
+}
+
+void Profiler::reset() {
+    counts_.fill({});
+    sites_.fill({});
+    depth_ = 0;
+    instructions_ = 0;
+    cycles_ = 0;
+}
+
+void Profiler::call(std::uint16_t site, std::uint16_t callee) {
+    if (depth_ == (int)stack_.size()) {
+        // the outermost call is never going to be returned from
+        std::copy(stack_.begin() + 1, stack_.end(), stack_.begin());
+        depth_--;
+    }
+    stack_[depth_++] = {site, callee, instructions_, cycles_};
+}
+
+void Profiler::ret() {
+    if (depth_ == 0) return;
+    const Frame &frame = stack_[--depth_];
+    CallSite &site = sites_[frame.site];
+    site.calls++;
+    site.instructions += instructions_ - frame.instructions;
+    site.cycles += cycles_ - frame.cycles;
+    site.callee = frame.callee;
+}
+
+bool Profiler::write_callgrind(const std::string &path, const std::string &rom_name) const {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::array<CallSite, 4096> sites = sites_;
+    for (int i = 0; i < depth_; i++) {
+        const Frame &frame = stack_[i];
+        CallSite &site = sites[frame.site];
+        site.calls++;
+        site.instructions += instructions_ - frame.instructions;
+        site.cycles += cycles_ - frame.cycles;
+        site.callee = frame.callee;
+    }
+
+    // addresses and call sites grouped by the subroutine they belong to
+    std::map<std::uint16_t, std::vector<std::uint16_t>> functions;
+    for (int pc = 0; pc < 4096; pc++) {
+        if (counts_[pc].executed != 0) functions[counts_[pc].function].push_back(pc);
+    }
+
+    out << "# callgrind format\nversion: 1\ncreator: chip8-emulator\n"
+        << "positions: instr\nevents: Instructions VipCycles\n"
+        << "summary: " << instructions_ << " " << cycles_ << "\n\n"
+        << "ob=" << rom_name << "\n";
+    char line[64];
+    for (const auto &[entry, addresses] : functions) {
+        out << "fn=" << function_name(entry) << "\n";
+        for (std::uint16_t pc : addresses) {
+            const Counts &counts = counts_[pc];
+            snprintf(line, sizeof(line), "0x%03X %llu %llu\n", pc, (unsigned long long)counts.executed,
+                     (unsigned long long)counts.cycles);
+            out << line;
+
+            const CallSite &site = sites[pc];
+            if (site.calls == 0) continue;
+            snprintf(line, sizeof(line), "calls=%llu 0x%03X\n", (unsigned long long)site.calls, site.callee);
+            out << "cfn=" << function_name(site.callee) << "\n" << line;
+            snprintf(line, sizeof(line), "0x%03X %llu %llu\n", pc, (unsigned long long)site.instructions,
+                     (unsigned long long)site.cycles);
+            out << line;
+        }
+        out << "\n";
+    }
+    return (bool)out;
+}
@@ -0,0 +1,87 @@
+#ifndef CHIP8_EMULATOR_PROFILER_H
+#define CHIP8_EMULATOR_PROFILER_H
+#include <array>
+#include <cstdint>
+#include <string>
+#include "chip8.h"
+
+// Guest code profiler driving Chip8::run_frame() through its hooks. Every
+// instruction bumps a counter for its address, and 2NNN/00EE are followed on
+// a shadow call stack so each call site gets its call count and inclusive
+// cost. Costs are kept in instructions and in COSMAC VIP cycles (Chip8::vip_cost).
+// All counters are flat 4Kb arrays indexed by address, nothing is allocated
+// while profiling.
+class Profiler {
+public:
+    static constexpr bool active = true;
+
+    void reset();
+
+    // run_frame() hooks
+    bool before_step(const Chip8 &chip8) {
+        std::uint16_t pc = chip8.PC & 0xFFF;
+        Counts &counts = counts_[pc];
+        if (counts.executed++ == 0) counts.function = function();
+        std::uint16_t cost = chip8.vip_cost[pc];
+        counts.cycles += cost;
+        instructions_++;
+        cycles_ += cost;
+
+        std::uint8_t high = chip8.memory[pc];
+        if ((high >> 4) == 0x2) {
+            call(pc, (high & 0xF) << 8 | chip8.memory[(pc + 1) & 0xFFF]);
+        } else if (high == 0x00 && chip8.memory[(pc + 1) & 0xFFF] == 0xEE) {
+            ret();
+        }
+        return false;
+    }
+
+    bool after_step(const Chip8 &) { return false; }
+
+    // Writes a callgrind profile: one function per subroutine entry point, the
+    // instruction addresses as positions. Calls still in progress count up to now.
+    bool write_callgrind(const std::string &path, const std::string &rom_name) const;
+
+    std::uint64_t instructions() const { return instructions_; }
+
+private:
+    // entry point of the subroutine running, 0x200 before any call
+    std::uint16_t function() const {
+        return depth_ == 0 ? 0x200 : stack_[depth_ - 1].callee;
+    }
+
+    void call(std::uint16_t site, std::uint16_t callee);
+    void ret();
+
+    struct Counts {
+        std::uint64_t executed = 0;
+        std::uint64_t cycles = 0;
+        // the subroutine the address was first run in
+        std::uint16_t function = 0;
+    };
+
+    // inclusive cost of the calls made from one 2NNN
+    struct CallSite {
+        std::uint64_t calls = 0;
+        std::uint64_t instructions = 0;
+        std::uint64_t cycles = 0;
+        std::uint16_t callee = 0;
+    };
+
+    struct Frame {
+        std::uint16_t site;
+        std::uint16_t callee;
+        std::uint64_t instructions;
+        std::uint64_t cycles;
+    };
+
+    std::array<Counts, 4096> counts_{};
+    std::array<CallSite, 4096> sites_{};
+    // deeper than the chip8 stack means the rom is not returning from its calls
+    std::array<Frame, 16> stack_{};
+    int depth_ = 0;
+
+    std::uint64_t instructions_ = 0;
+    std::uint64_t cycles_ = 0;
+};
+#endif //CHIP8_EMULATOR_PROFILER_H
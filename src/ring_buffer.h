@@ -0,0 +1,51 @@
+#ifndef CHIP8_EMULATOR_RING_BUFFER_H
+#define CHIP8_EMULATOR_RING_BUFFER_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+// Neither side ever blocks: writes past capacity and reads past the end are cut short.
+template <typename T, std::size_t Capacity>
+class RingBuffer {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // number of elements ready to read, exact on the consumer side and an upper bound elsewhere
+    std::size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    static constexpr std::size_t capacity() { return Capacity; }
+
+    // producer side, returns how many elements fit
+    std::size_t write(const T *data, std::size_t count) {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        std::size_t tail = tail_.load(std::memory_order_acquire);
+        count = std::min(count, Capacity - (head - tail));
+        for (std::size_t i = 0; i < count; i++) {
+            buffer_[(head + i) & (Capacity - 1)] = data[i];
+        }
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer side, returns how many elements were read
+    std::size_t read(T *data, std::size_t count) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t head = head_.load(std::memory_order_acquire);
+        count = std::min(count, head - tail);
+        for (std::size_t i = 0; i < count; i++) {
+            data[i] = buffer_[(tail + i) & (Capacity - 1)];
+        }
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    T buffer_[Capacity];
+    // free running counters, kept on separate cache lines so the two threads don't share one
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+};
+#endif //CHIP8_EMULATOR_RING_BUFFER_H
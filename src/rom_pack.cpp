@@ -0,0 +1,297 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "rom_pack.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static std::uint16_t read_u16(const std::uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static std::uint32_t read_u32(const std::uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
+}
+
+static void write_u32(std::ofstream &out, std::uint32_t value) {
+    char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24)};
+    out.write(bytes, 4);
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string &path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return false;
+    }
+    file_handle_ = file;
+    size_ = (std::size_t)file_size.QuadPart;
+    if (size_ == 0) return true;
+    mapping_handle_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle_ == nullptr) {
+        close();
+        return false;
+    }
+    data_ = (const std::uint8_t *)MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0);
+    if (data_ == nullptr) {
+        close();
+        return false;
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_ = (std::size_t)st.st_size;
+    if (size_ > 0) {
+        void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            size_ = 0;
+            return false;
+        }
+        data_ = (const std::uint8_t *)mapping;
+    }
+    // the mapping keeps the file alive on its own
+    ::close(fd);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (data_ != nullptr) UnmapViewOfFile(data_);
+    if (mapping_handle_ != nullptr) CloseHandle(mapping_handle_);
+    if (file_handle_ != nullptr) CloseHandle(file_handle_);
+    mapping_handle_ = nullptr;
+    file_handle_ = nullptr;
+#else
+    if (data_ != nullptr) munmap((void *)data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool RomPack::open(const std::string &path) {
+    entries_.clear();
+    names_.clear();
+    error_.clear();
+    path_ = path;
+
+    if (!file_.open(path)) {
+        error_ = "could not open " + path;
+        return false;
+    }
+
+    const std::uint8_t *data = file_.data();
+    std::size_t size = file_.size();
+
+    if (size >= 12 && memcmp(data, "C8PK", 4) == 0) {
+        format_ = Format::Pack;
+        return parse_pack();
+    }
+    if (size >= 22 && memcmp(data, "PK\x03\x04", 4) == 0) {
+        format_ = Format::Zip;
+        return parse_zip();
+    }
+    if (size >= 512 && memcmp(data + 257, "ustar", 5) == 0) {
+        format_ = Format::Tar;
+        return parse_tar();
+    }
+
+    format_ = Format::Raw;
+    entries_.push_back({path_, {data, size}});
+    return true;
+}
+
+const RomEntry *RomPack::find(std::string_view name) const {
+    for (const RomEntry &entry : entries_) {
+        if (entry.name == name) return &entry;
+    }
+    return nullptr;
+}
+
+bool RomPack::parse_tar() {
+    const std::uint8_t *data = file_.data();
+    std::size_t size = file_.size();
+    std::size_t offset = 0;
+
+    while (offset + 512 <= size) {
+        const std::uint8_t *header = data + offset;
+        // archives end with zero filled blocks
+        if (header[0] == 0) break;
+
+        std::uint64_t entry_size = 0;
+        for (int i = 124; i < 136 && header[i] >= '0' && header[i] <= '7'; i++) {
+            entry_size = entry_size * 8 + (header[i] - '0');
+        }
+        offset += 512;
+        if (entry_size > size - offset) {
+            error_ = "truncated tar entry in " + path_;
+            return false;
+        }
+
+        char type = (char)header[156];
+        if (type == '0' || type == '\0') {
+            std::string_view name((const char *)header, strnlen((const char *)header, 100));
+            std::string_view prefix((const char *)header + 345, strnlen((const char *)header + 345, 155));
+            if (!prefix.empty()) {
+                names_.push_back(std::string(prefix) + "/" + std::string(name));
+                name = names_.back();
+            }
+            entries_.push_back({name, {data + offset, (std::size_t)entry_size}});
+        }
+        offset += (entry_size + 511) / 512 * 512;
+    }
+    return true;
+}
+
+bool RomPack::parse_zip() {
+    const std::uint8_t *data = file_.data();
+    std::size_t size = file_.size();
+
+    // the end of central directory record sits in the last 22 + 65535 (max comment) bytes
+    std::size_t end_record = 0;
+    bool found = false;
+    std::size_t lowest = size > 22 + 65535 ? size - 22 - 65535 : 0;
+    for (std::size_t i = size - 22; i + 1 > lowest; i--) {
+        if (read_u32(data + i) == 0x06054b50) {
+            end_record = i;
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        error_ = "no zip central directory in " + path_;
+        return false;
+    }
+
+    std::uint16_t count = read_u16(data + end_record + 10);
+    std::size_t offset = read_u32(data + end_record + 16);
+
+    for (int i = 0; i < count; i++) {
+        if (offset + 46 > size || read_u32(data + offset) != 0x02014b50) {
+            error_ = "corrupt zip central directory in " + path_;
+            return false;
+        }
+        const std::uint8_t *central = data + offset;
+        std::uint16_t method = read_u16(central + 10);
+        std::uint32_t compressed_size = read_u32(central + 20);
+        std::uint16_t name_length = read_u16(central + 28);
+        std::uint16_t extra_length = read_u16(central + 30);
+        std::uint16_t comment_length = read_u16(central + 32);
+        std::size_t local_offset = read_u32(central + 42);
+        std::size_t next = offset + 46 + name_length + extra_length + comment_length;
+        if (next > size) {
+            error_ = "corrupt zip central directory in " + path_;
+            return false;
+        }
+        std::string_view name((const char *)central + 46, name_length);
+        offset = next;
+
+        // directories
+        if (!name.empty() && name.back() == '/') continue;
+
+        if (method != 0) {
+            error_ = "zip entry " + std::string(name) + " is compressed, only stored entries are supported";
+            return false;
+        }
+        if (local_offset + 30 > size || read_u32(data + local_offset) != 0x04034b50) {
+            error_ = "corrupt zip local header for " + std::string(name);
+            return false;
+        }
+        std::size_t data_offset = local_offset + 30 + read_u16(data + local_offset + 26) + read_u16(data + local_offset + 28);
+        if (data_offset + compressed_size > size) {
+            error_ = "truncated zip entry " + std::string(name);
+            return false;
+        }
+        entries_.push_back({name, {data + data_offset, compressed_size}});
+    }
+    return true;
+}
+
+bool RomPack::parse_pack() {
+    const std::uint8_t *data = file_.data();
+    std::size_t size = file_.size();
+
+    std::uint32_t version = read_u32(data + 4);
+    std::uint32_t count = read_u32(data + 8);
+    if (version != 1) {
+        error_ = "unsupported pack version " + std::to_string(version) + " in " + path_;
+        return false;
+    }
+    if (count > (size - 12) / 16) {
+        error_ = "truncated pack index in " + path_;
+        return false;
+    }
+
+    entries_.reserve(count);
+    for (std::uint32_t i = 0; i < count; i++) {
+        const std::uint8_t *index = data + 12 + i * 16;
+        std::uint64_t name_offset = read_u32(index);
+        std::uint64_t name_length = read_u32(index + 4);
+        std::uint64_t data_offset = read_u32(index + 8);
+        std::uint64_t data_size = read_u32(index + 12);
+        if (name_offset + name_length > size || data_offset + data_size > size) {
+            error_ = "pack entry " + std::to_string(i) + " points outside of " + path_;
+            return false;
+        }
+        entries_.push_back({{(const char *)data + name_offset, (std::size_t)name_length},
+                            {data + data_offset, (std::size_t)data_size}});
+    }
+    return true;
+}
+
+bool write_rom_pack(const std::string &out_path, const std::vector<std::string> &rom_paths) {
+    std::vector<std::vector<std::uint8_t>> roms;
+    for (const std::string &path : rom_paths) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) return false;
+        roms.emplace_back(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    std::ofstream out(out_path, std::ios::binary);
+    if (!out) return false;
+
+    std::uint32_t count = (std::uint32_t)rom_paths.size();
+    out.write("C8PK", 4);
+    write_u32(out, 1);
+    write_u32(out, count);
+
+    // names and data are laid out back to back after the index
+    std::uint32_t offset = 12 + count * 16;
+    for (std::uint32_t i = 0; i < count; i++) {
+        std::uint32_t name_length = (std::uint32_t)rom_paths[i].size();
+        std::uint32_t data_size = (std::uint32_t)roms[i].size();
+        write_u32(out, offset);
+        write_u32(out, name_length);
+        write_u32(out, offset + name_length);
+        write_u32(out, data_size);
+        offset += name_length + data_size;
+    }
+    for (std::uint32_t i = 0; i < count; i++) {
+        out.write(rom_paths[i].data(), rom_paths[i].size());
+        out.write((const char *)roms[i].data(), roms[i].size());
+    }
+    return (bool)out;
+}
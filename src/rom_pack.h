@@ -0,0 +1,74 @@
+#ifndef CHIP8_EMULATOR_ROM_PACK_H
+#define CHIP8_EMULATOR_ROM_PACK_H
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    const std::uint8_t *data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const std::uint8_t *data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    void *file_handle_ = nullptr;
+    void *mapping_handle_ = nullptr;
+#endif
+};
+
+struct RomEntry {
+    std::string_view name;
+    std::span<const std::uint8_t> data;
+};
+
+// A set of roms sliced out of one mapped file. The file can be a tar archive,
+// a zip archive whose entries are stored uncompressed, a C8PK pack (see
+// write_rom_pack) or a single raw rom. Entries point into the mapping, so they
+// stay valid for as long as the RomPack does.
+class RomPack {
+public:
+    enum class Format { Raw, Tar, Zip, Pack };
+
+    bool open(const std::string &path);
+
+    Format format() const { return format_; }
+    const std::vector<RomEntry> &entries() const { return entries_; }
+    const RomEntry *find(std::string_view name) const;
+
+    // why the last open() failed
+    const std::string &error() const { return error_; }
+
+private:
+    bool parse_tar();
+    bool parse_zip();
+    bool parse_pack();
+
+    MappedFile file_;
+    Format format_ = Format::Raw;
+    std::string path_;
+    std::vector<RomEntry> entries_;
+    std::deque<std::string> names_;
+    std::string error_;
+};
+
+// Writes the given rom files into a C8PK pack:
+//   "C8PK", u32 version (1), u32 entry count,
+//   entry table of { u32 name offset, u32 name length, u32 data offset, u32 data size },
+//   followed by the names and rom data. All integers are little endian.
+bool write_rom_pack(const std::string &out_path, const std::vector<std::string> &rom_paths);
+#endif //CHIP8_EMULATOR_ROM_PACK_H
@@ -0,0 +1,38 @@
+#include <cstdio>
+#include "stats.h"
+
+void write_stats_json(std::ostream &out, const RuntimeStats &stats, int indent) {
+    std::string pad(indent + 2, ' ');
+    out << "{\n"
+        << pad << "\"instructions\": " << stats.instructions() << ",\n"
+        << pad << "\"opcodes\": {";
+    for (int n = 0; n < 16; n++) {
+        out << (n == 0 ? "" : ", ") << "\"" << "0123456789ABCDEF"[n] << "\": " << stats.opcodes[n];
+    }
+    out << "},\n"
+        << pad << "\"draws\": " << stats.draws << ",\n"
+        << pad << "\"collisions\": " << stats.collisions << ",\n"
+        << pad << "\"frames\": " << stats.frames << ",\n"
+        << pad << "\"idle_frames\": " << stats.idle_frames << ",\n"
+        << pad << "\"skipped_frames\": " << stats.skipped_frames << ",\n"
+        << pad << "\"timer_ticks\": " << stats.timer_ticks << ",\n"
+        << pad << "\"input_polls\": " << stats.input_polls << "\n"
+        << std::string(indent, ' ') << "}";
+}
+
+std::string format_stats(const RuntimeStats &stats) {
+    std::uint64_t instructions = stats.instructions();
+    std::string text = std::to_string(instructions) + " instructions in " + std::to_string(stats.frames) +
+                       " frames (" + std::to_string(stats.idle_frames) + " ended on an idle loop, " +
+                       std::to_string(stats.skipped_frames) + " skipped)\n";
+    char line[64];
+    for (int n = 0; n < 16; n++) {
+        if (stats.opcodes[n] == 0) continue;
+        snprintf(line, sizeof(line), "  %Xxxx %12llu %5.1f%%\n", n, (unsigned long long)stats.opcodes[n],
+                 100.0 * stats.opcodes[n] / instructions);
+        text += line;
+    }
+    text += "  " + std::to_string(stats.draws) + " draws, " + std::to_string(stats.collisions) + " collisions, " +
+            std::to_string(stats.timer_ticks) + " timer ticks, " + std::to_string(stats.input_polls) + " input polls\n";
+    return text;
+}
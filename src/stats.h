@@ -0,0 +1,41 @@
+#ifndef CHIP8_EMULATOR_STATS_H
+#define CHIP8_EMULATOR_STATS_H
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Counters every tier keeps up to date as it runs, cheap enough to never be
+// switched off. They only ever grow; whoever wants a rate takes the difference
+// of two copies. The frontend copies them out once a frame for readers on
+// other threads (see main.cpp), the headless runner writes them as JSON.
+struct RuntimeStats {
+    // instructions run, by their first nibble (0NNN ... FXNN)
+    std::array<std::uint64_t, 16> opcodes{};
+    // DXYN, and the ones that turned a pixel off
+    std::uint64_t draws = 0;
+    std::uint64_t collisions = 0;
+    // frames run, and the frames whose end was skipped on an idle loop
+    std::uint64_t frames = 0;
+    std::uint64_t idle_frames = 0;
+    // frames whose picture the window never showed, drawn over before turbo
+    // or the frame pacer let it be published; headless runs have none
+    std::uint64_t skipped_frames = 0;
+    // timer ticks that found the delay or sound timer running
+    std::uint64_t timer_ticks = 0;
+    // EX9E, EXA1 and FX0A
+    std::uint64_t input_polls = 0;
+
+    constexpr std::uint64_t instructions() const {
+        std::uint64_t total = 0;
+        for (std::uint64_t count : opcodes) total += count;
+        return total;
+    }
+};
+
+// one JSON object, `indent` spaces in front of every line but the first
+void write_stats_json(std::ostream &out, const RuntimeStats &stats, int indent = 0);
+
+// a few lines for a terminal
+std::string format_stats(const RuntimeStats &stats);
+#endif //CHIP8_EMULATOR_STATS_H
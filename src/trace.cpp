@@ -0,0 +1,291 @@
+#include "trace.h"
+
+namespace {
+
+void put_u16(std::uint8_t *out, std::uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+void put_u32(std::uint8_t *out, std::uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = (value >> (i * 8)) & 0xFF;
+}
+
+void put_u64(std::uint8_t *out, std::uint64_t value) {
+    for (int i = 0; i < 8; i++) out[i] = (value >> (i * 8)) & 0xFF;
+}
+
+std::uint64_t get_le(const std::uint8_t *p, int bytes) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (std::uint64_t)p[i] << (i * 8);
+    return value;
+}
+
+bool get_varint(const std::uint8_t *&p, const std::uint8_t *end, std::uint32_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        std::uint8_t byte = *p++;
+        value |= (std::uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+const char magic[4] = {'C', '8', 'T', 'R'};
+const std::uint32_t version = 1;
+
+}
+
+TraceRecorder::~TraceRecorder() {
+    close();
+}
+
+bool TraceRecorder::open(const std::string &path, const Chip8 &chip8) {
+    close();
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        error_ = "could not open " + path + " for writing";
+        return false;
+    }
+    std::uint8_t header[8];
+    std::memcpy(header, magic, 4);
+    put_u32(header + 4, version);
+    file_.write((const char *)header, sizeof(header));
+
+    expected_pc_ = chip8.PC & 0xFFF;
+    std::copy(chip8.gpv_registers.begin(), chip8.gpv_registers.end(), v_.begin());
+    i_ = chip8.index_register;
+    sp_ = chip8.stack_pointer;
+    instructions_ = 0;
+    frames_ = 0;
+    bytes_ = sizeof(header);
+
+    free_.clear();
+    full_.clear();
+    for (int block = 0; block < block_count; block++) {
+        blocks_[block].data.resize(block_size);
+        free_.push(block);
+    }
+    closing_ = false;
+    writer_ = std::thread(&TraceRecorder::write_blocks, this);
+    start_block();
+    return true;
+}
+
+void TraceRecorder::close() {
+    if (!writer_.joinable()) return;
+    next_block();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    changed_.notify_all();
+    writer_.join();
+    // next_block() started one more block that is never written
+    current_ = -1;
+    out_ = end_ = nullptr;
+    file_.close();
+}
+
+void TraceRecorder::run_frame(Chip8 &chip8, int instructions) {
+    chip8.run_frame(instructions, *this);
+    if ((std::size_t)(end_ - out_) < max_record) next_block();
+    std::uint8_t *out = put_varint(out_, 1);
+    *out++ = chip8.delay_timer;
+    *out++ = chip8.sound_timer;
+    std::uint16_t keys = 0;
+    for (int key = 0; key < 16; key++) keys |= chip8.keys[key] << key;
+    put_u16(out, keys);
+    out_ = out + 2;
+    records_++;
+    frames_++;
+}
+
+std::uint8_t *TraceRecorder::put_changes(std::uint8_t *out, std::uint32_t changed, const Chip8 &chip8) {
+    for (int n = 0; n < 16; n++) {
+        if (changed & (1u << n)) {
+            *out++ = chip8.gpv_registers[n];
+            v_[n] = chip8.gpv_registers[n];
+        }
+    }
+    if (changed & (1u << 16)) {
+        out = put_varint(out, zigzag(chip8.index_register - i_));
+        i_ = chip8.index_register;
+    }
+    if (changed & (1u << 17)) {
+        *out++ = chip8.stack_pointer;
+        sp_ = chip8.stack_pointer;
+    }
+    return out;
+}
+
+void TraceRecorder::start_block() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // the writer is behind, the recorder waits for it rather than dropping records
+        changed_.wait(lock, [&] { return !free_.empty(); });
+        current_ = free_.pop();
+    }
+    std::uint8_t *data = blocks_[current_].data.data();
+    std::uint8_t *header = data + 8;
+    put_u64(header, instructions_);
+    put_u64(header + 8, frames_);
+    put_u16(header + 16, expected_pc_);
+    std::memcpy(header + 18, v_.data(), 16);
+    put_u16(header + 34, i_);
+    header[36] = sp_;
+    out_ = data + header_size;
+    end_ = data + block_size;
+    records_ = 0;
+}
+
+void TraceRecorder::next_block() {
+    if (current_ < 0) return;
+    Block &block = blocks_[current_];
+    block.size = out_ - block.data.data();
+    put_u32(block.data.data(), block.size - 8);
+    put_u32(block.data.data() + 4, records_);
+    bytes_ += block.size;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        full_.push(current_);
+    }
+    changed_.notify_all();
+    start_block();
+}
+
+void TraceRecorder::write_blocks() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        changed_.wait(lock, [&] { return !full_.empty() || closing_; });
+        if (full_.empty()) return;
+        int block = full_.pop();
+
+        // the file is only touched by this thread, the lock is only for the queues
+        lock.unlock();
+        if (file_ && !file_.write((const char *)blocks_[block].data.data(), blocks_[block].size)) {
+            error_ = "failed to write the trace";
+        }
+        lock.lock();
+        free_.push(block);
+        changed_.notify_all();
+    }
+}
+
+bool TraceReader::open(const std::string &path) {
+    if (!file_.open(path)) {
+        error_ = "could not open " + path;
+        return false;
+    }
+    if (file_.size() < 8 || std::memcmp(file_.data(), magic, 4) != 0 || get_le(file_.data() + 4, 4) != version) {
+        error_ = path + " is not a version 1 trace";
+        return false;
+    }
+    at_ = 8;
+    block_end_ = 8;
+    records_left_ = 0;
+    return true;
+}
+
+bool TraceReader::read_block_header() {
+    const std::uint8_t *data = file_.data();
+    const std::size_t header = 8 + 8 + 8 + 2 + 16 + 2 + 1;
+    if (file_.size() - at_ < header) {
+        if (at_ != file_.size()) error_ = "truncated block header";
+        return false;
+    }
+    std::size_t payload = get_le(data + at_, 4);
+    records_left_ = get_le(data + at_ + 4, 4);
+    if (payload > file_.size() - at_ - 8 || payload < header - 8) {
+        error_ = "truncated block";
+        return false;
+    }
+    block_end_ = at_ + 8 + payload;
+
+    const std::uint8_t *p = data + at_ + 8;
+    state_.index = get_le(p, 8);
+    state_.frame = get_le(p + 8, 8);
+    expected_pc_ = get_le(p + 16, 2);
+    std::memcpy(state_.v.data(), p + 18, 16);
+    state_.i = get_le(p + 34, 2);
+    state_.sp = p[36];
+    at_ += header;
+    return true;
+}
+
+bool TraceReader::skip_matching_block(TraceReader &other) {
+    if (records_left_ != 0 || other.records_left_ != 0) return false;
+    if (file_.size() - block_end_ < 8 || other.file_.size() - other.block_end_ < 8) return false;
+
+    const std::uint8_t *block = file_.data() + block_end_;
+    const std::uint8_t *other_block = other.file_.data() + other.block_end_;
+    std::size_t size = 8 + get_le(block, 4);
+    if (size != 8 + get_le(other_block, 4) || size > file_.size() - block_end_ ||
+        size > other.file_.size() - other.block_end_ || std::memcmp(block, other_block, size) != 0) {
+        return false;
+    }
+    block_end_ += size;
+    other.block_end_ += size;
+    return true;
+}
+
+bool TraceReader::next(TraceEntry &entry) {
+    while (records_left_ == 0) {
+        at_ = block_end_;
+        if (!read_block_header()) return false;
+    }
+
+    const std::uint8_t *p = file_.data() + at_;
+    const std::uint8_t *end = file_.data() + block_end_;
+    std::uint32_t head;
+    if (!get_varint(p, end, head)) {
+        error_ = "truncated record";
+        return false;
+    }
+
+    if (head & 1) {
+        if (end - p < 4) {
+            error_ = "truncated record";
+            return false;
+        }
+        state_.frame_end = true;
+        state_.delay_timer = p[0];
+        state_.sound_timer = p[1];
+        state_.keys = get_le(p + 2, 2);
+        state_.changed = 0;
+        p += 4;
+        entry = state_;
+        state_.frame++;
+    } else {
+        std::uint32_t changed;
+        if (end - p < 2) {
+            error_ = "truncated record";
+            return false;
+        }
+        state_.frame_end = false;
+        state_.pc = (expected_pc_ + unzigzag(head >> 1)) & 0xFFFF;
+        state_.opcode = p[0] << 8 | p[1];
+        p += 2;
+        if (!get_varint(p, end, changed)) {
+            error_ = "truncated record";
+            return false;
+        }
+        state_.changed = changed;
+        for (int n = 0; n < 16; n++) {
+            if (changed & (1u << n)) {
+                if (p == end) break;
+                state_.v[n] = *p++;
+            }
+        }
+        std::uint32_t delta;
+        if ((changed & (1u << 16)) && get_varint(p, end, delta)) state_.i += unzigzag(delta);
+        if ((changed & (1u << 17)) && p < end) state_.sp = *p++;
+
+        expected_pc_ = state_.pc + 2;
+        entry = state_;
+        state_.index++;
+    }
+    at_ = p - file_.data();
+    records_left_--;
+    return true;
+}
@@ -0,0 +1,205 @@
+#ifndef CHIP8_EMULATOR_TRACE_H
+#define CHIP8_EMULATOR_TRACE_H
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+#include "rom_pack.h"
+
+// Binary execution trace, one record per instruction and one per frame.
+//
+// File: "C8TR", u32 version (1), then blocks of
+//   u32 payload size, u32 record count, u64 instructions before the block,
+//   u64 frames before the block, the state the records are relative to
+//   (u16 expected PC, V0-VF, u16 I, u8 SP), then the records.
+// Instruction record: varint zigzag(PC - expected PC) << 1, u16 opcode (big
+//   endian), varint mask of the registers it changed (bit n VN, 16 I, 17 SP),
+//   then the new value of each changed register in that order: one byte for
+//   V and SP, a zigzag varint delta for I. The next expected PC is PC + 2.
+// Frame record: varint 1, u8 DT, u8 ST, u16 keypad mask, after the timer tick.
+// All integers are little endian unless noted. Blocks start from a full
+// state so a reader can seek to any of them.
+
+inline std::uint8_t *put_varint(std::uint8_t *out, std::uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = (std::uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (std::uint8_t)value;
+    return out;
+}
+
+constexpr std::uint32_t zigzag(int value) {
+    return ((std::uint32_t)value << 1) ^ (std::uint32_t)(value >> 31);
+}
+
+constexpr int unzigzag(std::uint32_t value) {
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+// Records a trace while driving Chip8::run_frame() through its hooks. Records
+// go into large blocks that a background thread writes out, so the emulation
+// thread only encodes. MegaChip and VIP timing frames don't call the hooks,
+// so the frontends refuse to trace them.
+class TraceRecorder {
+public:
+    static constexpr bool active = true;
+    static constexpr std::size_t block_size = 1 << 20;
+
+    TraceRecorder() = default;
+    ~TraceRecorder();
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+    // starts a trace of `chip8` from its current state
+    bool open(const std::string &path, const Chip8 &chip8);
+    // writes out what is buffered and waits for the writer
+    void close();
+
+    void run_frame(Chip8 &chip8, int instructions);
+
+    std::uint64_t instructions() const { return instructions_; }
+    std::uint64_t bytes() const { return bytes_; }
+    // why open() failed, or the write that failed
+    const std::string &error() const { return error_; }
+
+    // run_frame() hooks
+    bool before_step(const Chip8 &chip8) {
+        pc_ = chip8.PC & 0xFFF;
+        opcode_ = chip8.memory[pc_] << 8 | chip8.memory[(pc_ + 1) & 0xFFF];
+        return false;
+    }
+
+    bool after_step(const Chip8 &chip8) {
+        if ((std::size_t)(end_ - out_) < max_record) next_block();
+        std::uint8_t *out = put_varint(out_, zigzag(pc_ - expected_pc_) << 1);
+        *out++ = opcode_ >> 8;
+        *out++ = opcode_ & 0xFF;
+
+        std::uint32_t changed = 0;
+        if (std::memcmp(v_.data(), chip8.gpv_registers.data(), 16) != 0) {
+            for (int n = 0; n < 16; n++) {
+                if (v_[n] != chip8.gpv_registers[n]) changed |= 1u << n;
+            }
+        }
+        if (chip8.index_register != i_) changed |= 1u << 16;
+        if (chip8.stack_pointer != sp_) changed |= 1u << 17;
+        out = put_varint(out, changed);
+        if (changed != 0) out = put_changes(out, changed, chip8);
+
+        out_ = out;
+        expected_pc_ = pc_ + 2;
+        records_++;
+        instructions_++;
+        return false;
+    }
+
+private:
+    // header plus the largest record, an instruction changing every register
+    static constexpr std::size_t header_size = 4 + 4 + 8 + 8 + 2 + 16 + 2 + 1;
+    static constexpr std::size_t max_record = 3 + 2 + 3 + 16 + 3 + 1;
+    static constexpr int block_count = 4;
+
+    std::uint8_t *put_changes(std::uint8_t *out, std::uint32_t changed, const Chip8 &chip8);
+    void start_block();
+    // hands the current block to the writer and starts another
+    void next_block();
+    void write_blocks();
+
+    std::uint8_t *out_ = nullptr;
+    std::uint8_t *end_ = nullptr;
+    std::uint16_t pc_ = 0;
+    std::uint16_t opcode_ = 0;
+
+    // the state the next record is relative to
+    int expected_pc_ = 0x200;
+    std::array<std::uint8_t, 16> v_{};
+    std::uint16_t i_ = 0;
+    std::uint8_t sp_ = 0;
+
+    std::uint32_t records_ = 0;
+    std::uint64_t instructions_ = 0;
+    std::uint64_t frames_ = 0;
+    std::uint64_t bytes_ = 0;
+
+    // blocks cycle between the recorder and the writer thread
+    struct Block {
+        std::vector<std::uint8_t> data;
+        std::size_t size = 0;
+    };
+    // A queue of block indices. It never holds more than the block_count
+    // blocks there are, so it is a fixed ring that never allocates.
+    struct BlockQueue {
+        std::array<int, block_count> blocks{};
+        std::uint32_t head = 0;
+        std::uint32_t tail = 0;
+
+        bool empty() const { return head == tail; }
+        void push(int block) { blocks[tail++ % block_count] = block; }
+        int pop() { return blocks[head++ % block_count]; }
+        void clear() { head = tail = 0; }
+    };
+    std::array<Block, block_count> blocks_;
+    int current_ = -1;
+    BlockQueue free_;
+    BlockQueue full_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool closing_ = false;
+    std::thread writer_;
+    std::ofstream file_;
+    std::string error_;
+};
+
+// one record and the machine state after it
+struct TraceEntry {
+    bool frame_end = false;
+    // instructions and frames before this record
+    std::uint64_t index = 0;
+    std::uint64_t frame = 0;
+    std::uint16_t pc = 0;
+    std::uint16_t opcode = 0;
+    std::uint32_t changed = 0;
+
+    std::array<std::uint8_t, 16> v{};
+    std::uint16_t i = 0;
+    std::uint8_t sp = 0;
+    // only set by frame records
+    std::uint8_t delay_timer = 0;
+    std::uint8_t sound_timer = 0;
+    std::uint16_t keys = 0;
+};
+
+// Reads a trace back a record at a time from a mapping of the file.
+class TraceReader {
+public:
+    bool open(const std::string &path);
+
+    // the next record, false at the end or on a damaged block (see error())
+    bool next(TraceEntry &entry);
+
+    // Skips the next block in both readers when both are between blocks and
+    // the blocks are byte for byte the same, so comparing two traces only
+    // decodes from the first block that differs.
+    bool skip_matching_block(TraceReader &other);
+
+    const std::string &error() const { return error_; }
+
+private:
+    bool read_block_header();
+
+    MappedFile file_;
+    std::size_t at_ = 0;
+    std::size_t block_end_ = 0;
+    std::uint32_t records_left_ = 0;
+    int expected_pc_ = 0x200;
+    TraceEntry state_;
+    std::string error_;
+};
+#endif //CHIP8_EMULATOR_TRACE_H
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string>
+#include "trace.h"
+
+// chip8-trace: prints, filters and compares traces recorded with --trace.
+
+static void show_trace_usage(const std::string &name) {
+    std::cerr << "Usage: " << name << " <command> <trace(s)> <option(s)>\n"
+              << "Commands:\n"
+              << "\tprint <trace>\t\tOne line per instruction: index, frame, PC, opcode and the registers it changed\n"
+              << "\tdiff <a> <b>\t\tReport the first record where two traces differ\n"
+              << "\tstats <trace>\t\tInstruction and frame counts and the encoded size\n"
+              << "Options:\n"
+              << "\t--from <n>\t\tStart printing at instruction n\n"
+              << "\t--count <n>\t\tPrint at most n lines\n"
+              << "\t--pc <addr>\t\tOnly instructions at this address (hex)\n"
+              << "\t--op <pattern>\t\tOnly opcodes matching a pattern, x matches any digit (e.g. Dxyx, Fx33)\n"
+              << "\t--frames\t\tAlso print frame records with the timers and keypad\n"
+              << "\t--context <n>\t\tRecords of a to show before a difference (default 8)"
+              << std::endl;
+}
+
+static std::string format_entry(const TraceEntry &entry) {
+    char line[160];
+    if (entry.frame_end) {
+        snprintf(line, sizeof(line), "%10llu  frame %llu end  DT=%02X ST=%02X keys=%04X",
+                 (unsigned long long)entry.index, (unsigned long long)entry.frame,
+                 entry.delay_timer, entry.sound_timer, entry.keys);
+        return line;
+    }
+    snprintf(line, sizeof(line), "%10llu  f%-6llu %03X  %04X ", (unsigned long long)entry.index,
+             (unsigned long long)entry.frame, entry.pc, entry.opcode);
+    std::string out = line;
+    for (int n = 0; n < 16; n++) {
+        if (entry.changed & (1u << n)) {
+            snprintf(line, sizeof(line), " V%X=%02X", n, entry.v[n]);
+            out += line;
+        }
+    }
+    if (entry.changed & (1u << 16)) {
+        snprintf(line, sizeof(line), " I=%03X", entry.i);
+        out += line;
+    }
+    if (entry.changed & (1u << 17)) {
+        snprintf(line, sizeof(line), " SP=%X", entry.sp);
+        out += line;
+    }
+    return out;
+}
+
+// the full register state, for showing a difference
+static std::string format_state(const TraceEntry &entry) {
+    char line[160];
+    snprintf(line, sizeof(line), "PC %03X opcode %04X I %03X SP %X ", entry.pc, entry.opcode, entry.i, entry.sp);
+    std::string out = line;
+    for (int n = 0; n < 16; n++) {
+        snprintf(line, sizeof(line), " V%X=%02X", n, entry.v[n]);
+        out += line;
+    }
+    return out;
+}
+
+static bool matches(std::uint16_t opcode, const std::string &pattern) {
+    for (int i = 0; i < 4; i++) {
+        char c = pattern[i];
+        if (c == 'x' || c == 'X' || c == 'y' || c == 'Y' || c == 'n' || c == 'N') continue;
+        int digit = (opcode >> ((3 - i) * 4)) & 0xF;
+        if (std::strtol(std::string(1, c).c_str(), nullptr, 16) != digit) return false;
+    }
+    return true;
+}
+
+static bool same(const TraceEntry &a, const TraceEntry &b) {
+    if (a.frame_end != b.frame_end) return false;
+    if (a.frame_end) {
+        return a.delay_timer == b.delay_timer && a.sound_timer == b.sound_timer && a.keys == b.keys;
+    }
+    return a.pc == b.pc && a.opcode == b.opcode && a.v == b.v && a.i == b.i && a.sp == b.sp;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help") {
+        show_trace_usage(argv[0]);
+        return argc < 3 ? 1 : 0;
+    }
+    std::string command = argv[1];
+    int first_option = command == "diff" ? 4 : 3;
+    if (argc < first_option) {
+        show_trace_usage(argv[0]);
+        return 1;
+    }
+
+    unsigned long long from = 0;
+    long long count = -1;
+    int pc = -1;
+    std::string op;
+    bool frames = false;
+    int context = 8;
+    for (int i = first_option; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--from" && i + 1 < argc) {
+            from = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--count" && i + 1 < argc) {
+            count = std::atoll(argv[++i]);
+        } else if (arg == "--pc" && i + 1 < argc) {
+            pc = std::strtol(argv[++i], nullptr, 16);
+        } else if (arg == "--op" && i + 1 < argc) {
+            op = argv[++i];
+            if (op.size() != 4) {
+                std::cerr << "--op takes four hex digits or x" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--frames") {
+            frames = true;
+        } else if (arg == "--context" && i + 1 < argc) {
+            context = std::max(0, std::atoi(argv[++i]));
+        }
+    }
+
+    TraceReader a;
+    if (!a.open(argv[2])) {
+        std::cerr << a.error() << std::endl;
+        return 1;
+    }
+    TraceEntry entry;
+
+    if (command == "print") {
+        while (count != 0 && a.next(entry)) {
+            if (entry.index < from) continue;
+            if (entry.frame_end ? !frames : (pc >= 0 && entry.pc != pc) || (!op.empty() && !matches(entry.opcode, op))) {
+                continue;
+            }
+            std::cout << format_entry(entry) << "\n";
+            if (count > 0) count--;
+        }
+    } else if (command == "stats") {
+        std::uint64_t instructions = 0, frame_count = 0;
+        while (a.next(entry)) {
+            if (entry.frame_end) frame_count++;
+            else instructions++;
+        }
+        std::FILE *file = std::fopen(argv[2], "rb");
+        long size = 0;
+        if (file != nullptr) {
+            std::fseek(file, 0, SEEK_END);
+            size = std::ftell(file);
+            std::fclose(file);
+        }
+        std::cout << instructions << " instructions, " << frame_count << " frames, " << size << " bytes, "
+                  << (instructions == 0 ? 0.0 : (double)size / instructions) << " bytes an instruction\n";
+    } else if (command == "diff") {
+        TraceReader b;
+        if (!b.open(argv[3])) {
+            std::cerr << b.error() << std::endl;
+            return 1;
+        }
+        // the last few records, only formatted if a difference turns up
+        std::deque<TraceEntry> before;
+        TraceEntry other;
+        while (true) {
+            // identical blocks are skipped without decoding them
+            while (a.skip_matching_block(b)) before.clear();
+            bool has_a = a.next(entry);
+            bool has_b = b.next(other);
+            if (!has_a || !has_b) {
+                // a damaged block stops either reader early, before its real end
+                if (!a.error().empty() || !b.error().empty()) {
+                    if (!a.error().empty()) std::cerr << argv[2] << ": " << a.error() << std::endl;
+                    if (!b.error().empty()) std::cerr << argv[3] << ": " << b.error() << std::endl;
+                    return 1;
+                }
+                if (has_a == has_b) {
+                    std::cout << "traces match\n";
+                    break;
+                }
+                std::cout << (has_a ? argv[3] : argv[2]) << " ends first, at instruction "
+                          << (has_a ? entry.index : other.index) << "\n";
+                return 1;
+            }
+            if (!same(entry, other)) {
+                for (const TraceEntry &earlier : before) std::cout << "  " << format_entry(earlier) << "\n";
+                std::cout << "- " << format_entry(entry) << "\n+ " << format_entry(other) << "\n";
+                if (!entry.frame_end && !other.frame_end) {
+                    std::cout << "a: " << format_state(entry) << "\nb: " << format_state(other) << "\n";
+                }
+                return 1;
+            }
+            if (context > 0) {
+                before.push_back(entry);
+                if ((int)before.size() > context) before.pop_front();
+            }
+        }
+    } else {
+        show_trace_usage(argv[0]);
+        return 1;
+    }
+
+    if (!a.error().empty()) {
+        std::cerr << a.error() << std::endl;
+        return 1;
+    }
+    return 0;
+}
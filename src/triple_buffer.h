@@ -0,0 +1,39 @@
+#ifndef CHIP8_EMULATOR_TRIPLE_BUFFER_H
+#define CHIP8_EMULATOR_TRIPLE_BUFFER_H
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer handing whole values from one producer thread to one
+// consumer thread. The producer always has a slot to write into and the
+// consumer always sees the newest published value; values the consumer never
+// got around to reading are overwritten.
+template <typename T>
+class TripleBuffer {
+public:
+    // producer side: fill this, then publish()
+    T &back() { return slots_[back_]; }
+
+    void publish() {
+        // swap the back slot with the middle one and mark it fresh
+        back_ = middle_.exchange(back_ | fresh_bit, std::memory_order_acq_rel) & index_mask;
+    }
+
+    // consumer side: returns true when a newer value was published since the last call
+    bool update() {
+        if ((middle_.load(std::memory_order_relaxed) & fresh_bit) == 0) return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    const T &front() const { return slots_[front_]; }
+
+private:
+    static constexpr std::uint8_t fresh_bit = 0x4;
+    static constexpr std::uint8_t index_mask = 0x3;
+
+    T slots_[3]{};
+    std::uint8_t back_ = 0;
+    std::uint8_t front_ = 1;
+    alignas(64) std::atomic<std::uint8_t> middle_{2};
+};
+#endif //CHIP8_EMULATOR_TRIPLE_BUFFER_H
@@ -1,33 +1,25 @@
 #include <cstdint>
-#include <vector>
-#include <assert.h>
 #include <iostream>
-
-std::uint8_t nibble_1(std::uint8_t byte) {
-    return ((byte & 0xF0) >> 4);
-}
-
-std::uint8_t nibble_2(std::uint8_t byte) {
-    return (byte & 0x0F);
-}
-
-bool get_bit(std::uint8_t byte, std::uint8_t index) {
-    assert(0 <= index <= 7);
-    int i = 7 - index;
-    return (byte & 1 << i) >> i;
-}
-
-void collect_digits(std::vector<std::uint8_t>& digits, std::uint8_t num) {
-    if (num > 9) {
-        collect_digits(digits, num / 10);
-    }
-    digits.push_back(num % 10);
-}
+#include "utils.h"
 
 void show_usage(std::string name) {
     std::cerr << "Usage: " << name << " <option(s)>\n"
               << "Options:\n"
               << "\t-h,--help\t\tShow this help message\n"
-              << "\t-d,--debug print debug messages into the console and go opcode by opcode on keyboard input"
+              << "\t-d,--debug\t\tStart paused with a debugger reading commands from the console, a key release steps while paused\n"
+              << "\t--gdb <port>\t\tDebug with a GDB remote protocol server on 127.0.0.1:<port>\n"
+              << "\t--trace <file>\t\tRecord every instruction to a binary trace, read it with chip8-trace\n"
+              << "\t--profile <file>\tWrite a callgrind profile of the rom's subroutines at exit\n"
+              << "\t--rom <name>\t\tLoad this entry when the file is a tar, zip or C8PK pack\n"
+              << "\t--speed <n>\t\tRun at n times normal speed, or as fast as possible with 'unlimited'. Tab toggles turbo\n"
+              << "\t--overlay\t\tShow instructions and frames per second, frame times and CPU use, F1 toggles it\n"
+              << "\t--zones <file>\t\tWrite a Chrome trace of the host frame pipeline at exit (-DCHIP8_ZONES=ON builds)\n"
+              << "\t--ipf <n>\t\tInstructions per 60hz frame (default 12)\n"
+              << "\t--hz <n>\t\tInstructions per second, rounded to whole frames (default 700)\n"
+              << "\t--no-idle-skip\t\tRun polling loops instruction by instruction instead of skipping to the next frame\n"
+              << "\t--fuse\t\t\tExecute common opcode sequences as superinstructions\n"
+              << "\t--tiered\t\tCompile hot straight line code into pre-decoded blocks\n"
+              << "\t--vip-timing\t\tCharge instructions their COSMAC VIP cycle costs instead of a fixed --ipf\n"
+              << "\t--megachip\t\tRun the rom as MegaChip8, which roms larger than 4Kb always are"
               << std::endl;
 }
\ No newline at end of file
@@ -1,9 +1,24 @@
 //
 // Created by kolby on 2/20/2022.
 //
+#ifndef CHIP8_EMULATOR_UTILS_H
+#define CHIP8_EMULATOR_UTILS_H
+#include <cstdint>
+#include <string>
+
+constexpr std::uint8_t nibble_1(std::uint8_t byte) {
+    return ((byte & 0xF0) >> 4);
+}
+
+constexpr std::uint8_t nibble_2(std::uint8_t byte) {
+    return (byte & 0x0F);
+}
+
+// bit `index` counting from the most significant bit
+constexpr bool get_bit(std::uint8_t byte, std::uint8_t index) {
+    int i = 7 - index;
+    return (byte & 1 << i) >> i;
+}
 
-std::uint8_t nibble_1(std::uint8_t byte);
-std::uint8_t nibble_2(std::uint8_t byte);
-bool get_bit(std::uint8_t byte, std::uint8_t index);
-void collect_digits(std::vector<std::uint8_t>& digits, std::uint8_t num);
 void show_usage(std::string name);
+#endif //CHIP8_EMULATOR_UTILS_H
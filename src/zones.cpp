@@ -0,0 +1,95 @@
+#include "zones.h"
+#ifdef CHIP8_ZONES
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+struct Zone {
+    const char *name;
+    clock::time_point start;
+    clock::time_point end;
+};
+
+// One thread's zones. Only that thread writes; `recorded` is published with
+// release so a reader sees every zone it counts.
+struct ZoneRing {
+    static constexpr std::size_t capacity = 1 << 16;
+
+    std::array<Zone, capacity> zones;
+    std::atomic<std::uint64_t> recorded{0};
+    const char *name = nullptr;
+    int id = 0;
+};
+
+std::mutex rings_mutex;
+std::vector<std::unique_ptr<ZoneRing>> rings;
+const clock::time_point epoch = clock::now();
+
+thread_local ZoneRing *this_thread_ring = nullptr;
+
+ZoneRing &ring() {
+    if (this_thread_ring == nullptr) {
+        // the thread's first zone, the only time recording takes a lock
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(std::make_unique<ZoneRing>());
+        this_thread_ring = rings.back().get();
+        this_thread_ring->id = (int)rings.size();
+    }
+    return *this_thread_ring;
+}
+
+double microseconds(clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}
+
+ZoneScope::~ZoneScope() {
+    ZoneRing &zones = ring();
+    std::uint64_t index = zones.recorded.load(std::memory_order_relaxed);
+    zones.zones[index % ZoneRing::capacity] = {name_, start_, clock::now()};
+    zones.recorded.store(index + 1, std::memory_order_release);
+}
+
+void zones_name_thread(const char *name) {
+    ring().name = name;
+}
+
+bool zones_write(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    // trace times are in microseconds, zones can be shorter than one
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+    bool first = true;
+    for (const auto &zones : rings) {
+        if (zones->name != nullptr) {
+            out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << zones->id
+                << ", \"args\": {\"name\": \"" << zones->name << "\"}}";
+            first = false;
+        }
+        // the ring only holds the most recent zones
+        std::uint64_t recorded = zones->recorded.load(std::memory_order_acquire);
+        std::uint64_t begin = recorded > ZoneRing::capacity ? recorded - ZoneRing::capacity : 0;
+        for (std::uint64_t i = begin; i < recorded; i++) {
+            const Zone &zone = zones->zones[i % ZoneRing::capacity];
+            out << (first ? "" : ",\n") << "{\"name\": \"" << zone.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                << zones->id << ", \"ts\": " << microseconds(zone.start - epoch)
+                << ", \"dur\": " << microseconds(zone.end - zone.start) << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return (bool)out;
+}
+#endif
@@ -0,0 +1,47 @@
+#ifndef CHIP8_EMULATOR_ZONES_H
+#define CHIP8_EMULATOR_ZONES_H
+#include <string>
+
+// Scoped timing zones for the frontend's frame pipeline, written out as a
+// Chrome trace (chrome://tracing, or ui.perfetto.dev) with --zones <file>.
+// Only built with -DCHIP8_ZONES=ON; otherwise CHIP8_ZONE() is nothing at all.
+//
+// Every thread records into its own ring of the most recent zones, so
+// recording is two clock reads and a store with no lock or allocation after
+// the thread's first zone. The rings are read once the threads are done.
+
+#ifdef CHIP8_ZONES
+#include <chrono>
+
+inline constexpr bool zones_enabled = true;
+
+class ZoneScope {
+public:
+    // `name` must outlive the trace, in practice a string literal
+    explicit ZoneScope(const char *name) : name_(name), start_(std::chrono::steady_clock::now()) {}
+    ~ZoneScope();
+    ZoneScope(const ZoneScope &) = delete;
+    ZoneScope &operator=(const ZoneScope &) = delete;
+
+private:
+    const char *name_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// names the calling thread in the trace
+void zones_name_thread(const char *name);
+
+// writes every thread's zones, once the threads recording them have stopped
+bool zones_write(const std::string &path);
+
+#define CHIP8_ZONE_JOIN2(a, b) a##b
+#define CHIP8_ZONE_JOIN(a, b) CHIP8_ZONE_JOIN2(a, b)
+#define CHIP8_ZONE(name) ZoneScope CHIP8_ZONE_JOIN(zone_, __LINE__)(name)
+#else
+inline constexpr bool zones_enabled = false;
+inline void zones_name_thread(const char *) {}
+inline bool zones_write(const std::string &) { return false; }
+
+#define CHIP8_ZONE(name) ((void)0)
+#endif
+#endif //CHIP8_EMULATOR_ZONES_H